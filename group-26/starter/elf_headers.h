@@ -0,0 +1,170 @@
+/*
+ * ELF header reading shared by the loaders (starter/without-bonus, starter/with-bonus and grp-26_A4).
+ * Either class is read, and ELF32 headers are widened to the Elf64 structures the loaders work with.
+ * The including file defines the ehdr, phdr and fd globals and loader_cleanup(). The functions are
+ * static, so every file of a program may include this header.
+ */
+#ifndef ELF_HEADERS_H
+#define ELF_HEADERS_H
+
+#include <elf.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// ELF class and machine of the executables this loader can run, the same as its own
+#if defined(__x86_64__)
+#define LOADER_CLASS ELFCLASS64
+#define LOADER_MACHINE EM_X86_64
+#else
+#define LOADER_CLASS ELFCLASS32
+#define LOADER_MACHINE EM_386
+#endif
+
+// most program headers accepted
+#define LOADER_MAX_PHNUM 1024
+
+extern Elf64_Ehdr *ehdr;
+extern Elf64_Phdr *phdr;
+extern int fd;
+void loader_cleanup();
+
+/*
+ * widen ELF32 headers to the ELF64 form the loader works with
+ */
+static inline void widen_ehdr(Elf32_Ehdr* e32, Elf64_Ehdr* e64){
+  memcpy(e64->e_ident, e32->e_ident, EI_NIDENT);
+  e64->e_type = e32->e_type;
+  e64->e_machine = e32->e_machine;
+  e64->e_version = e32->e_version;
+  e64->e_entry = e32->e_entry;
+  e64->e_phoff = e32->e_phoff;
+  e64->e_shoff = e32->e_shoff;
+  e64->e_flags = e32->e_flags;
+  e64->e_ehsize = e32->e_ehsize;
+  e64->e_phentsize = e32->e_phentsize;
+  e64->e_phnum = e32->e_phnum;
+  e64->e_shentsize = e32->e_shentsize;
+  e64->e_shnum = e32->e_shnum;
+  e64->e_shstrndx = e32->e_shstrndx;
+}
+
+static inline void widen_phdr(Elf32_Phdr* p32, Elf64_Phdr* p64){
+  p64->p_type = p32->p_type;
+  p64->p_flags = p32->p_flags;
+  p64->p_offset = p32->p_offset;
+  p64->p_vaddr = p32->p_vaddr;
+  p64->p_paddr = p32->p_paddr;
+  p64->p_filesz = p32->p_filesz;
+  p64->p_memsz = p32->p_memsz;
+  p64->p_align = p32->p_align;
+}
+
+/*
+ * check an ELF header in its 64-bit form: the magic, a little-endian ET_EXEC of the loader's own class and
+ * machine (a 64-bit loader cannot run 32-bit code and the other way round, and the segments are mapped at
+ * their link addresses, so position-independent executables are refused), and a program header table of
+ * 1 to LOADER_MAX_PHNUM entries of the class's size. Prints the reason and returns false otherwise
+ */
+static inline bool check_elf_header(Elf64_Ehdr* e){
+  unsigned char* ident = e->e_ident;
+  if (memcmp(ident, ELFMAG, SELFMAG) != 0) {
+    fprintf(stderr, "Not an ELF file\n");
+    return false;
+  }
+  if (ident[EI_CLASS] != ELFCLASS32 && ident[EI_CLASS] != ELFCLASS64) {
+    fprintf(stderr, "Unknown ELF class %d\n", ident[EI_CLASS]);
+    return false;
+  }
+  bool is64 = ident[EI_CLASS] == ELFCLASS64;
+  if (ident[EI_DATA] != ELFDATA2LSB) {
+    fprintf(stderr, "Only little-endian ELF files are supported\n");
+    return false;
+  }
+  if (e->e_type != ET_EXEC) {
+    fprintf(stderr, e->e_type == ET_DYN ? "Position-independent executables are not supported, link with -no-pie\n"
+                                        : "Not an executable ELF file\n");
+    return false;
+  }
+  if (ident[EI_CLASS] != LOADER_CLASS || e->e_machine != LOADER_MACHINE) {
+    fprintf(stderr, "ELF%d executable for machine %d cannot run in this %d-bit loader\n",
+            is64 ? 64 : 32, e->e_machine, LOADER_CLASS == ELFCLASS64 ? 64 : 32);
+    return false;
+  }
+  if (e->e_phentsize != (is64 ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr)) || e->e_phnum == 0 ||
+      e->e_phnum > LOADER_MAX_PHNUM) {
+    fprintf(stderr, "Bad program header table\n");
+    return false;
+  }
+  return true;
+}
+
+/*
+ * read the ELF header and program headers of either class from fd into ehdr and phdr, in their 64-bit
+ * form, after check_elf_header. Exits through loader_cleanup() on any error
+ */
+static inline void read_elf_headers(){
+  unsigned char ident[EI_NIDENT];
+  if (pread(fd, ident, EI_NIDENT, 0) != EI_NIDENT || memcmp(ident, ELFMAG, SELFMAG) != 0) {
+    fprintf(stderr, "Not an ELF file\n");
+    loader_cleanup();
+    exit(1);
+  }
+  bool is64 = ident[EI_CLASS] == ELFCLASS64;
+
+  ehdr = (Elf64_Ehdr*)malloc(sizeof(Elf64_Ehdr));
+  if (!ehdr) {
+    perror("Memory allocation failed for ehdr");
+    loader_cleanup();
+    exit(1);
+  }
+  Elf32_Ehdr e32;
+  size_t ehdr_size = is64 ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr);
+  ssize_t read_bytes = pread(fd, is64 ? (void*)ehdr : (void*)&e32, ehdr_size, 0);
+  if (read_bytes < 0) {
+    perror("Failed to read ELF header");
+    loader_cleanup();
+    exit(1);
+  } else if (read_bytes != (ssize_t)ehdr_size) {
+    fprintf(stderr, "File too short\n");
+    loader_cleanup();
+    exit(1);
+  }
+  if (!is64) {
+    widen_ehdr(&e32, ehdr);
+  }
+  if (!check_elf_header(ehdr)) {
+    loader_cleanup();
+    exit(1);
+  }
+
+  // Allocate memory for program headers = entry size * no. of entries
+  size_t table_size = ehdr->e_phentsize * ehdr->e_phnum;
+  phdr = (Elf64_Phdr*)malloc(sizeof(Elf64_Phdr) * ehdr->e_phnum);
+  void* table = is64 ? (void*)phdr : malloc(table_size);
+  if (!phdr || !table) {
+    perror("Memory allocation failed for phdr");
+    loader_cleanup();
+    exit(1);
+  }
+  read_bytes = pread(fd, table, table_size, ehdr->e_phoff);
+  if (read_bytes < 0) {
+    perror("Failed to read phdr");
+    loader_cleanup();
+    exit(1);
+  } else if (read_bytes != (ssize_t)table_size) {
+    fprintf(stderr, "Incomplete read of program header\n");
+    loader_cleanup();
+    exit(1);
+  }
+  if (!is64) {
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+      widen_phdr((Elf32_Phdr*)table + i, &phdr[i]);
+    }
+    free(table);
+  }
+}
+
+#endif
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Runs per second of test/quick through the fork server, against starting bin/launch once per run.
+# Usage: ./bench.sh [runs]
+RUNS=${1:-5000}
+SOCK=/tmp/launch-bench.$$
+bin/launch --server test/quick $SOCK > /dev/null &
+SERVER=$!
+while [ ! -S $SOCK ]; do sleep 0.01; done
+echo "== fork server: $RUNS runs"
+bin/launch --client $SOCK $RUNS
+kill $SERVER
+rm -f $SOCK
+
+N=$((RUNS / 10))
+echo "== one launch process per run: $N runs"
+t0=$(date +%s.%N)
+i=0; while [ $i -lt $N ]; do bin/launch test/quick > /dev/null; i=$((i + 1)); done
+t1=$(date +%s.%N)
+awk -v a="$t0" -v b="$t1" -v n=$N 'BEGIN { printf "%d runs in %.3f s: %.0f runs/s\n", n, b - a, n / (b - a) }'
@@ -1,15 +1,143 @@
-#include "loader.h"
+#include "image.h"
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
-int main(int argc, char** argv) 
+double now_seconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// reply to one request: status is the child's wait status, 0 when _start returned normally, or -1 when
+// the child could not be forked; result is the return value of _start when status is 0
+typedef struct {
+  int status;
+  int result;
+} reply;
+
+/*
+ * fork server: load the executable once and keep it mapped, then for every request byte read from a
+ * client run _start in a forked copy-on-write child, wait for it and send the client a reply, also when
+ * the child crashed. Requests are run one at a time, so a long run delays every other client: they wait
+ * in the listen backlog until the current client disconnects. Each client may send any number of
+ * requests on its connection.
+ */
+void serve(char* exe, char* socket_path){
+  entry_fn _start = load_elf_image(exe);
+  signal(SIGPIPE, SIG_IGN);  // a client that goes away only ends its connection
+  // the child leaves the return value of _start here for the parent to send
+  int* child_result = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(child_result == MAP_FAILED){
+    perror("mmap failed");
+    exit(1);
+  }
+
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+  unlink(socket_path);
+  if(server < 0 || bind(server, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(server, 16) < 0){
+    perror("Failed to listen on socket");
+    exit(1);
+  }
+  printf("Serving %s on %s\n", exe, socket_path);
+  fflush(stdout);
+
+  while(1){
+    int client = accept(server, NULL, NULL);
+    if(client < 0){
+      perror("accept failed");
+      continue;
+    }
+    char request;
+    while(read(client, &request, 1) == 1){
+      reply r = {-1, 0};
+      pid_t pid = fork();
+      if(pid == 0){
+        close(server);
+        close(client);
+        *child_result = _start();
+        _exit(0);
+      }
+      // one child at a time keeps the replies in request order
+      if(pid < 0){
+        perror("fork failed");
+      } else if(waitpid(pid, &r.status, 0) < 0){
+        perror("waitpid failed");
+        r.status = -1;
+      } else if(r.status == 0){
+        r.result = *child_result;
+      }
+      if(write(client, &r, sizeof(r)) != sizeof(r)){
+        break;
+      }
+    }
+    close(client);
+  }
+}
+
+/*
+ * client: send runs requests to a fork server and report the throughput
+ */
+void client(char* socket_path, int runs){
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+  if(sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+    perror("Failed to connect to fork server");
+    exit(1);
+  }
+  reply r = {0, 0};
+  double start = now_seconds();
+  for(int i = 0; i < runs; i++){
+    if(write(sock, "r", 1) != 1 || read(sock, &r, sizeof(r)) != sizeof(r)){
+      fprintf(stderr, "Fork server closed the connection after %d runs\n", i);
+      exit(1);
+    }
+    if(r.status != 0){
+      if(r.status == -1){
+        fprintf(stderr, "Run %d: the fork server could not start the executable\n", i + 1);
+      } else if(WIFSIGNALED(r.status)){
+        fprintf(stderr, "Run %d: the executable was killed by signal %d\n", i + 1, WTERMSIG(r.status));
+      } else {
+        fprintf(stderr, "Run %d: the executable exited with status %d\n", i + 1, WEXITSTATUS(r.status));
+      }
+      exit(1);
+    }
+  }
+  double secs = now_seconds() - start;
+  printf("User _start return value = %d\n", r.result);
+  printf("%d runs in %.3f s: %.0f runs/s\n", runs, secs, runs / secs);
+  close(sock);
+}
+
+int main(int argc, char** argv)
 {
+  if(argc == 4 && strcmp(argv[1], "--server") == 0) {
+    serve(argv[2], argv[3]);
+  }
+  if(argc == 4 && strcmp(argv[1], "--client") == 0) {
+    client(argv[2], atoi(argv[3]));
+    return 0;
+  }
   if(argc != 2) {
     printf("Usage: %s <ELF Executable> \n",argv[0]);
+    printf("       %s --server <ELF Executable> <socket>\n", argv[0]);
+    printf("       %s --client <socket> <runs>\n", argv[0]);
     exit(1);
   }
   // 1. carry out necessary checks on the input ELF file
   // 2. passing it to the loader for carrying out the loading/execution
-  load_and_run_elf(argv[1]);
-  // 3. invoke the cleanup routine inside the loader  
+  load_and_run_elf(argv);
+  // 3. invoke the cleanup routine inside the loader
   loader_cleanup();
   return 0;
 }
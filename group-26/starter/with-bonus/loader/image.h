@@ -0,0 +1,9 @@
+/*
+ * loading an executable without running it, used by the fork server in launch.c
+ */
+
+#include "loader.h"
+
+typedef int (*entry_fn)();
+
+entry_fn load_elf_image(char* path);
@@ -1,29 +1,6 @@
-#include "loader.h"
-
-Elf32_Ehdr *ehdr;
-Elf32_Phdr *phdr;
-int fd;
-
 /*
- * release memory and other cleanups
+ * lib_simpleloader.so is the without-bonus loader built without its main. Besides load_and_run_elf()
+ * it exports load_elf_image(), declared in image.h, for the fork server in launch.c
  */
-void loader_cleanup() {
-  
-}
-
-/*
- * Load and run the ELF executable file
- */
-void load_and_run_elf(char** exe) {
-  fd = open(argv[1], O_RDONLY);
-  // 1. Load entire binary content into the memory from the ELF file.
-  // 2. Iterate through the PHDR table and find the section of PT_LOAD 
-  //    type that contains the address of the entrypoint method in fib.c
-  // 3. Allocate memory of the size "p_memsz" using mmap function 
-  //    and then copy the segment content
-  // 4. Navigate to the entrypoint address into the segment loaded in the memory in above step
-  // 5. Typecast the address to that of function pointer matching "_start" method in fib.c.
-  // 6. Call the "_start" method and print the value returned from the "_start"
-  int result = _start();
-  printf("User _start return value = %d\n",result);
-}
+#define LOADER_LIBRARY
+#include "../../without-bonus/loader.c"
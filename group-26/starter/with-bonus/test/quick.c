@@ -0,0 +1,6 @@
+/*
+ * returns at once, so a run measures only the cost of starting it
+ */
+int _start() {
+	return 42;
+}
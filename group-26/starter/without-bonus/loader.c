@@ -1,7 +1,12 @@
 #include "loader.h"
+#include "../elf_headers.h"
+#include <stdbool.h>
 
-Elf32_Ehdr *ehdr;
-Elf32_Phdr *phdr;
+// entry point of a loaded executable, the type of the "_start" method in fib.c
+typedef int (*entry_fn)();
+
+Elf64_Ehdr *ehdr;
+Elf64_Phdr *phdr;
 int fd;
 /*
  * release memory and other cleanups
@@ -21,59 +26,24 @@ void loader_cleanup(){
 
 }
 
-// Load and run the ELF executable file
- 
-void load_and_run_elf(char** exe){
-  fd=open(exe[1],O_RDONLY);
+/*
+ * Load the ELF executable file without running it and return its entry point. load_and_run_elf() runs
+ * it once; the fork server in with-bonus/launcher runs it in a fresh copy-on-write child per request.
+ */
+entry_fn load_elf_image(char* path){
+  fd=open(path,O_RDONLY);
   if(fd < 0){
     perror("Failed to open file");
     exit(1);
   }
-  // 1. Load entire binary content into the memory from the ELF file.
-  ehdr = (Elf32_Ehdr*)malloc(sizeof(Elf32_Ehdr));
-  if(!ehdr){
-    perror("Memory allocation failed for ehdr");
-    loader_cleanup();
-    exit(1);
-  }
-  ssize_t read_bytes = read(fd, ehdr, sizeof(Elf32_Ehdr));
-  if (read_bytes< 0) {
-    perror("Failed to read ELF header");
-    loader_cleanup();
-    exit(1);
-} else if (read_bytes != sizeof(Elf32_Ehdr)) {
-    perror("File too short");
-    loader_cleanup();
-    exit(1);
-}
-  phdr = (Elf32_Phdr*)malloc(ehdr->e_phentsize * ehdr->e_phnum); // Allocate memory for program headers = entry size * no. of entries
-  if(!phdr){
-    perror("Memory allocation failed for phdr");
-    loader_cleanup();
-    exit(1);
-  }
-  if(lseek(fd,ehdr->e_phoff,SEEK_SET) < 0){
-    perror("Failed to seek program headers");
-    loader_cleanup();
-    exit(1);
-  }
-  ssize_t phdr_read_bytes = read(fd, phdr, ehdr->e_phentsize * ehdr->e_phnum);
-  if (phdr_read_bytes < 0) {
-    perror("Failed to read phdr");
-    loader_cleanup();
-    exit(1);
-  } 
-  else if (phdr_read_bytes != sizeof(Elf32_Phdr)) {
-    perror("Incomplete read of program header");
-    loader_cleanup();
-    exit(1);
-  }
+  // 1. Load the ELF header and program headers, widened to their 64-bit form for either class
+  read_elf_headers();
 
   // 2. Iterate through the PHDR table and find the section of PT_LOAD 
   //    type that contains the address of the entrypoint method in fib.c
-  Elf32_Phdr* phdr_load = NULL;
+  Elf64_Phdr* phdr_load = NULL;
   for(int i=0;i<ehdr->e_phnum;i++){
-    Elf32_Phdr* curr = &phdr[i];
+    Elf64_Phdr* curr = &phdr[i];
     if(curr->p_type == PT_LOAD){
       if(curr->p_vaddr <= ehdr->e_entry && ehdr->e_entry <= curr->p_vaddr + curr->p_memsz){
         phdr_load = curr;
@@ -88,40 +58,66 @@ void load_and_run_elf(char** exe){
   }
 
 
-// 3. Allocate memory of the size "p_memsz" using mmap function 
-//    and then copy the segment content
-void *mem = mmap(NULL,phdr_load->p_memsz, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANONYMOUS| MAP_PRIVATE, 0,0);
-if(mem == MAP_FAILED){
-  perror("Memory mapping failed");
-  loader_cleanup();
-  exit(1);
-}
-
-if(lseek(fd,phdr_load->p_offset, SEEK_SET) < 0){
-  perror("Failed to seek segment");
-  loader_cleanup();
-  exit(1);
-}
-ssize_t segment_read_bytes = read(fd, mem, phdr_load->p_filesz);
-if (segment_read_bytes < 0) {
-  perror("Failed to read segment data");
-  loader_cleanup();
-  exit(1);
+  // 3. Map the segment. The file part is mapped MAP_PRIVATE straight from the ELF file from the page
+  //    holding p_offset, so nothing is copied and clean pages are shared between runs of the same binary.
+  //    Only the tail of the page where the file data ends is zeroed; the rest of p_memsz (bss) is anonymous.
+  long page_size = sysconf(_SC_PAGESIZE);
+  unsigned long delta = phdr_load->p_offset % page_size;    // position of the segment inside its first page
+  if (delta != phdr_load->p_vaddr % page_size) {
+    fprintf(stderr, "Segment offset and address are not page-congruent\n");
+    loader_cleanup();
+    exit(1);
+  }
+  int prot = 0;
+  if (phdr_load->p_flags & PF_R) prot |= PROT_READ;
+  if (phdr_load->p_flags & PF_W) prot |= PROT_WRITE;
+  if (phdr_load->p_flags & PF_X) prot |= PROT_EXEC;
 
-} else if (segment_read_bytes != (ssize_t)phdr_load->p_filesz) {
-    perror("Error: Incomplete segment read ");
+  // reserve the whole segment first, so the file and bss mappings land next to each other
+  size_t total = (delta + phdr_load->p_memsz + page_size - 1) & ~(page_size - 1);
+  char *base = mmap(NULL, total, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if(base == MAP_FAILED){
+    perror("Memory mapping failed");
     loader_cleanup();
     exit(1);
-}
+  }
+  size_t file_bytes = delta + phdr_load->p_filesz;
+  size_t file_pages = (file_bytes + page_size - 1) & ~(page_size - 1);
+  bool partial = file_bytes < file_pages && phdr_load->p_memsz > phdr_load->p_filesz;
+  if (file_pages > 0 && mmap(base, file_pages, partial ? prot | PROT_WRITE : prot, MAP_FIXED | MAP_PRIVATE,
+                             fd, phdr_load->p_offset - delta) == MAP_FAILED) {
+    perror("Failed to map segment data");
+    loader_cleanup();
+    exit(1);
+  }
+  if (partial) {
+    memset(base + file_bytes, 0, file_pages - file_bytes);
+    mprotect(base + file_pages - page_size, page_size, prot);
+  }
+  if (total > file_pages && mmap(base + file_pages, total - file_pages, prot,
+                                 MAP_FIXED | MAP_ANONYMOUS | MAP_PRIVATE, -1, 0) == MAP_FAILED) {
+    perror("Failed to map bss");
+    loader_cleanup();
+    exit(1);
+  }
+  void *mem = base + delta;
   // 4. Navigate to the entrypoint address into the segment loaded in the memory in above step
-  int (_start)() = (int()()) (mem + (ehdr->e_entry - phdr_load->p_vaddr));
   // 5. Typecast the address to that of a function pointer matching the "_start" method in fib.c.
-  // done with step 4.
+  return (entry_fn) ((char*)mem + (ehdr->e_entry - phdr_load->p_vaddr));
+}
+
+/*
+ * Load and run the ELF executable file
+ */
+void load_and_run_elf(char** exe){
+  entry_fn _start = load_elf_image(exe[1]);
   // 6. Call the "_start" method and print the value returned from the "_start"
   int result = _start();
   printf("User _start return value = %d\n", result);
 }
 
+// the with-bonus loader library is built from this file with LOADER_LIBRARY, launch.c has its own main
+#ifndef LOADER_LIBRARY
 int main(int argc, char** argv) 
 {
   if(argc != 2) {
@@ -136,3 +132,4 @@ int main(int argc, char** argv)
   loader_cleanup();
   return 0;
 }
+#endif
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Benchmarks for simpleshell. Run with "make bench".
+SHELL_BIN=./simpleshell
+
+# 1 GiB through a 3-stage pipeline: default pipes with an external cat, large pipes with an
+# external cat, and large pipes with the built-in splice cat
+echo "== pipeline: 1 GiB through producer | cat | consumer =="
+printf 'pipesize 0\nhead -c 1073741824 /dev/zero | /bin/cat | wc -c\npipesize 1048576\nhead -c 1073741824 /dev/zero | /bin/cat | wc -c\nhead -c 1073741824 /dev/zero | cat | wc -c\nhistory\n' \
+    | $SHELL_BIN | grep -E "Cmd:|stage 2:"
+
+# command throughput of script mode: the same script with fork + exec of the cached path, and with posix_spawn
+echo "== script mode: 20000 simple commands =="
+SCRIPT=$(mktemp)
+i=0; while [ $i -lt 20000 ]; do echo "true"; i=$((i + 1)); done > "$SCRIPT"
+for mode in off on; do
+    { echo "spawn $mode"; cat "$SCRIPT"; } > "$SCRIPT.$mode"
+    t0=$(date +%s.%N)
+    $SHELL_BIN "$SCRIPT.$mode" > /dev/null 2>&1
+    t1=$(date +%s.%N)
+    awk -v a="$t0" -v b="$t1" -v m="$mode" 'BEGIN { printf "spawn %s: %.0f commands/s\n", m, 20000 / (b - a) }'
+    rm -f "$SCRIPT.$mode"
+done
+rm -f "$SCRIPT"
+
+# parser throughput without running anything: long pipelines with quotes, redirections and sequencing
+echo "== parser: 200000 lines =="
+LINES=$(mktemp)
+i=0; while [ $i -lt 2000 ]; do
+    echo "cat 'some file' < in.txt | grep -v \"a b\" | sort -k 2 | uniq -c >> out.txt && echo done\ ok; true &"
+    i=$((i + 1))
+done > "$LINES.one"
+i=0; while [ $i -lt 100 ]; do cat "$LINES.one"; i=$((i + 1)); done > "$LINES"
+$SHELL_BIN --parse-bench "$LINES"
+rm -f "$LINES" "$LINES.one"
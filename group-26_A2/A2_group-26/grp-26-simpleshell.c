@@ -1,28 +1,124 @@
+#define _GNU_SOURCE // splice, tee and F_SETPIPE_SZ
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <sys/wait.h>
-#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <signal.h>
+#include <spawn.h>
 #include <time.h>
 
-#define MAX_CMD_LEN 1024 //defined for buffer size
-#define MAX_ARGS 1000
-#define MAX_HISTORY 1000
+#define MAX_CMD_LEN 1024 //defined for path buffers, command lines can be any length
+#define HIST_CAPACITY 65536 // entries kept in the history ring
+#define HIST_CMD_LEN 256 // bytes of each command kept in history
+#define HIST_FILE ".simpleshell_history"
+#define HIST_MAGIC 0x53534833 // changes whenever cmdent or cmd_stats changes, older files are recreated
+#define STATS_BUCKETS 4096 // distinct command names with aggregate stats
+#define DUR_BINS 160 // duration histogram bins, 1 us up to several days
+#define MAX_STAGES 8 // pipeline stages whose resource usage is kept in history
+#define SPLICE_CHUNK (1 << 20) // bytes moved per splice/tee call by the built-in stages
+#define MAX_JOBS 64 // background jobs tracked at once
+#define PATH_CACHE_SIZE 256 // buckets of the command path cache
+
+extern char** environ;
+
+// resource usage of one process of a command, from wait4
+typedef struct {
+    pid_t pid;
+    double end_offset;          // seconds from the command's start until this process exited
+    double user_cpu;            // user CPU time in seconds
+    double sys_cpu;             // system CPU time in seconds
+    long max_rss;               // peak resident set size in KiB
+    long nvcsw;                 // voluntary context switches (blocked on I/O or a pipe)
+    long nivcsw;                // involuntary context switches (preempted)
+    long inblock;               // block input operations
+    long oublock;               // block output operations
+    long long bytes_out;        // bytes written to stdout, pipeline stages only
+} stage_usage;
 
 //this struct encapsulates the command string, its process ID (PID), the time it started, and its total execution duration.
+// entries live in a memory-mapped history file, so the struct has a fixed size and no pointers.
 
 typedef struct {
-    char* cmd_str;              // command string entered by the user
+    long long seq;              // position in the history since the file was created
+    pid_t owner;                // shell that ran the command, used to show the current session
     pid_t pid;                  // process ID of the executed command
     double start_time;          // timestamp when the command started
     double execution_duration;  // how long the command took to run, in seconds
+    int nstages;                // processes with recorded usage: 1 for simple commands, one per pipeline stage
+    stage_usage stages[MAX_STAGES];
+    char cmd_str[HIST_CMD_LEN]; // command string entered by the user, truncated if longer
 } cmdent;
 
-// global array to store the history of commands as an array of structs, and history counts
-cmdent history_log[MAX_HISTORY];
-int histc = 0;
+// running totals for one command name, updated as each entry completes so they never need a scan
+typedef struct {
+    char name[64];              // first word of the command, empty for a free slot
+    long long count;
+    double total_duration;
+    double min_duration, max_duration; // bound the p95 taken from the histogram
+    unsigned int dur_bins[DUR_BINS]; // log-scale histogram of durations, for the p95
+} cmd_stats;
+
+// the history file: this header, then a trigram signature per slot (the search index), then the ring
+// of entries, then the per-command stats table
+typedef struct {
+    unsigned int magic;
+    unsigned int capacity;      // number of ring slots
+    long long total;            // entries ever appended, the next one goes to slot total % capacity
+    char pad[4096 - 16];        // keeps the sections page aligned
+} hist_header;
+
+hist_header* hist_hdr = NULL;
+unsigned long long* hist_sigs = NULL; // hist_sigs[slot] has a bit set for every trigram of that entry
+cmdent* history_log = NULL;           // ring buffer of entries
+cmd_stats* hist_stats = NULL;
+long long session_start = 0;          // first seq of this shell's session
+
+// capacity requested for every pipeline pipe with F_SETPIPE_SZ, 0 keeps the kernel default
+int pipe_capacity = 1 << 20;
+
+// a background job is one command or pipeline running in its own process group
+typedef enum {
+    JOB_FREE,
+    JOB_RUNNING,
+    JOB_STOPPED,
+    JOB_DONE
+} job_state;
+
+typedef struct {
+    volatile sig_atomic_t state;
+    pid_t pgid;                 // process group shared by all stages
+    pid_t last_pid;             // last stage, its exit status is the job's status
+    int nalive;                 // processes not yet reaped
+    int status;                 // wait status of the last stage
+    long long hist_seq;         // history entry whose duration is filled in when the job finishes
+    double start;               // monotonic start time
+    char* cmd;
+} job;
+
+// job number n is job_table[n - 1]; entries are only changed with SIGCHLD blocked or from its handler
+job job_table[MAX_JOBS];
+int shell_exit = 0; // set by the 'exit' built-in, checked after every command of a line
+
+FILE* input = NULL;   // stdin, or the script given on the command line
+int script_mode = 0;  // no prompt when running a script
+int use_spawn = 0;    // 'spawn on' starts simple commands with posix_spawn instead of fork
+
+// remembers where each command name was found in PATH, like bash's hash table. The whole cache is
+// dropped when PATH changes.
+typedef struct path_ent {
+    char* name;
+    char* path;
+    int hits;
+    struct path_ent* next;
+} path_ent;
+
+path_ent* path_cache[PATH_CACHE_SIZE];
+char* cached_path_env = NULL; // PATH value the cache was built for
 
 //prints the local time from a given tstamp.
 void print_formatted_time(double tstamp) {
@@ -33,31 +129,258 @@ void print_formatted_time(double tstamp) {
     printf("%s", buffer);
 }
 
-// manages the history log as a circular buffer. If the log is full, it discards the oldest entry to make room for the new one.
- 
-void add_to_history(char* command, pid_t pid, struct timeval start, struct timeval end) {
-    if (histc < MAX_HISTORY) {
-        history_log[histc].cmd_str = strdup(command);
-        history_log[histc].pid = pid;
-        history_log[histc].start_time = start.tv_sec + start.tv_usec / 1e6;
-        history_log[histc].execution_duration = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
-        histc++;
-    } 
-    else {
-        perror("MAX HISTORY MEMORY LIMIT EXCEEDED."); //history full
+// maps the history file (~/.simpleshell_history), creating it on first use. If it cannot be opened the ring is
+// kept in anonymous memory instead and the history only lasts for this session.
+void init_history() {
+    size_t size = sizeof(hist_header) + HIST_CAPACITY * (sizeof(unsigned long long) + sizeof(cmdent))
+                  + STATS_BUCKETS * sizeof(cmd_stats);
+    char path[MAX_CMD_LEN];
+    const char* home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/%s", home ? home : ".", HIST_FILE);
+
+    void* base = MAP_FAILED;
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd >= 0) {
+        hist_header existing;
+        ssize_t n = read(fd, &existing, sizeof(existing.magic) + sizeof(existing.capacity));
+        if (n != sizeof(existing.magic) + sizeof(existing.capacity) || existing.magic != HIST_MAGIC
+            || existing.capacity != HIST_CAPACITY) {
+            ftruncate(fd, 0); // new file, or one written with another layout: start over
+        }
+        if (ftruncate(fd, size) == 0) { // sparse, only slots that are used take disk space
+            base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+    }
+    if (base == MAP_FAILED) {
+        perror("history file unavailable, keeping history in memory");
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            perror("mmap failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    hist_hdr = base;
+    hist_sigs = (unsigned long long*)(hist_hdr + 1);
+    history_log = (cmdent*)(hist_sigs + HIST_CAPACITY);
+    hist_stats = (cmd_stats*)(history_log + HIST_CAPACITY);
+    if (hist_hdr->magic != HIST_MAGIC) {
+        hist_hdr->capacity = HIST_CAPACITY;
+        hist_hdr->total = 0;
+        hist_hdr->magic = HIST_MAGIC;
+    }
+    session_start = hist_hdr->total;
+}
+
+// bloom-style signature of all trigrams in a string. An entry can only contain a query as a substring if
+// its signature has every bit of the query's signature set.
+unsigned long long trigram_sig(const char* s) {
+    unsigned long long sig = 0;
+    for (size_t i = 0; s[i] && s[i + 1] && s[i + 2]; i++) {
+        unsigned int h = (unsigned char)s[i] * 31 * 31 + (unsigned char)s[i + 1] * 31 + (unsigned char)s[i + 2];
+        sig |= 1ULL << (h % 64);
+    }
+    return sig;
+}
+
+// durations are measured on CLOCK_MONOTONIC so they are immune to wall clock changes
+double monotonic_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// entry with the given seq, or NULL once the ring has overwritten it
+cmdent* history_entry(long long seq) {
+    if (seq < 0 || seq >= hist_hdr->total || hist_hdr->total - seq > HIST_CAPACITY) {
+        return NULL;
+    }
+    cmdent* e = &history_log[seq % HIST_CAPACITY];
+    return e->seq == seq ? e : NULL;
+}
+
+// histogram bin of a duration: four bins per power of two microseconds
+int duration_bin(double secs) {
+    unsigned long long us = (unsigned long long)(secs * 1e6) + 1;
+    int msb = 63 - __builtin_clzll(us);
+    int bin = msb * 4 + (msb >= 2 ? (int)((us >> (msb - 2)) & 3) : 0);
+    return bin < DUR_BINS ? bin : DUR_BINS - 1;
+}
+
+// lower bound in seconds of the durations in a histogram bin
+double bin_seconds(int bin) {
+    int msb = bin / 4;
+    unsigned long long us = msb >= 2 ? (1ULL << msb) | ((unsigned long long)(bin % 4) << (msb - 2)) : (1ULL << msb);
+    return (us - 1) / 1e6;
+}
+
+// upper bound in seconds of the durations in a histogram bin, below two microseconds there is one bin
+// per power of two
+double bin_upper_seconds(int bin) {
+    int msb = bin / 4;
+    return bin_seconds(msb >= 2 ? bin + 1 : (msb + 1) * 4);
+}
+
+// adds a finished entry to the running stats of its command name
+void history_account(cmdent* e) {
+    char name[sizeof(hist_stats[0].name)];
+    snprintf(name, sizeof(name), "%.*s", (int)strcspn(e->cmd_str, " |;&"), e->cmd_str);
+    unsigned int h = 5381;
+    for (char* c = name; *c; c++) {
+        h = h * 33 + (unsigned char)*c;
+    }
+    for (int probe = 0; probe < STATS_BUCKETS; probe++) { // open addressing, linear probing
+        cmd_stats* st = &hist_stats[(h + probe) % STATS_BUCKETS];
+        if (st->name[0] == '\0') {
+            strcpy(st->name, name);
+        } else if (strcmp(st->name, name) != 0) {
+            continue;
+        }
+        if (st->count == 0 || e->execution_duration < st->min_duration) {
+            st->min_duration = e->execution_duration;
+        }
+        if (st->count == 0 || e->execution_duration > st->max_duration) {
+            st->max_duration = e->execution_duration;
+        }
+        st->count++;
+        st->total_duration += e->execution_duration;
+        st->dur_bins[duration_bin(e->execution_duration)]++;
+        return;
+    }
+}
+
+// appends an entry to the ring, overwriting the oldest one when it is full, and returns its seq.
+// the stats are updated here unless the command is still running (a background job), see finish_history.
+long long add_to_history(char* command, pid_t pid, double start, double end) {
+    long long seq = __atomic_fetch_add(&hist_hdr->total, 1, __ATOMIC_SEQ_CST); // other shells may share the file
+    cmdent* e = &history_log[seq % HIST_CAPACITY];
+    memset(e, 0, sizeof(*e));
+    snprintf(e->cmd_str, sizeof(e->cmd_str), "%s", command);
+    e->owner = getpid();
+    e->pid = pid;
+    e->start_time = time(NULL) - (monotonic_now() - start); // wall clock time of the monotonic start
+    e->execution_duration = end - start;
+    hist_sigs[seq % HIST_CAPACITY] = trigram_sig(e->cmd_str);
+    e->seq = seq;
+    if (e->execution_duration > 0) {
+        history_account(e);
+    }
+    return seq;
+}
+
+// accounts a background job's entry once handle_sigchld has filled in its duration
+void finish_history(long long seq) {
+    cmdent* e = history_entry(seq);
+    if (e) {
+        history_account(e);
+    }
+}
+
+void print_entry(cmdent* e) {
+    printf("%lld: PID=%d, ", e->seq + 1, e->pid);
+    printf("Start: ");
+    print_formatted_time(e->start_time);
+    printf(", Duration: %.4f s, ", e->execution_duration);
+    printf("Cmd: \"%s\"\n", e->cmd_str);
+    for (int j = 0; e->nstages > 1 && j < e->nstages; j++) { // per-stage throughput of pipelines
+        double mb = e->stages[j].bytes_out / (1024.0 * 1024.0);
+        double secs = e->execution_duration;
+        printf("    stage %d: %lld bytes out, %.2f MiB/s\n", j + 1, e->stages[j].bytes_out, secs > 0 ? mb / secs : 0.0);
     }
 }
 
-//iterates through the global history_log and prints the serial number,PID, start time, execution duration, and the command itself for each entry.
+// copies a wait4 result into a stage record
+void record_usage(stage_usage* su, struct rusage* ru, double end_offset) {
+    su->end_offset = end_offset;
+    su->user_cpu = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6;
+    su->sys_cpu = ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+    su->max_rss = ru->ru_maxrss;
+    su->nvcsw = ru->ru_nvcsw;
+    su->nivcsw = ru->ru_nivcsw;
+    su->inblock = ru->ru_inblock;
+    su->oublock = ru->ru_oublock;
+}
+
+// built-in 'history --stats': per-process resource usage of this session's commands, showing which stage of a
+// pipeline the time went to. cpu% is the stage's share of the whole command's CPU time.
+void display_usage_stats() {
+    printf("\n--- Resource Usage ---\n");
+    long long first = hist_hdr->total - HIST_CAPACITY > session_start ? hist_hdr->total - HIST_CAPACITY : session_start;
+    for (long long seq = first; seq < hist_hdr->total; seq++) {
+        cmdent* e = history_entry(seq);
+        if (!e || e->owner != getpid() || e->nstages == 0) {
+            continue;
+        }
+        double total_cpu = 0;
+        for (int j = 0; j < e->nstages; j++) {
+            total_cpu += e->stages[j].user_cpu + e->stages[j].sys_cpu;
+        }
+        printf("%lld: \"%s\", wall %.4f s, cpu %.4f s\n", e->seq + 1, e->cmd_str, e->execution_duration, total_cpu);
+        printf("    %-5s %7s %9s %9s %9s %6s %10s %7s %7s %7s %7s %12s\n", "stage", "pid", "exit(s)", "user(s)",
+               "sys(s)", "cpu%", "rss(KiB)", "vcsw", "ivcsw", "blk-in", "blk-out", "bytes-out");
+        for (int j = 0; j < e->nstages; j++) {
+            stage_usage* su = &e->stages[j];
+            double cpu = su->user_cpu + su->sys_cpu;
+            printf("    %-5d %7d %9.4f %9.4f %9.4f %6.1f %10ld %7ld %7ld %7ld %7ld %12lld\n", j + 1, su->pid,
+                   su->end_offset, su->user_cpu, su->sys_cpu, total_cpu > 0 ? 100.0 * cpu / total_cpu : 0.0,
+                   su->max_rss, su->nvcsw, su->nivcsw, su->inblock, su->oublock, su->bytes_out);
+        }
+    }
+    printf("-----------------\n");
+}
+
+//iterates through this session's entries in the ring and prints the serial number,PID, start time, execution duration, and the command itself for each entry.
 
 void display_history() {
     printf("\n--- Command History ---\n");
-    for (int i = 0; i < histc; i++) {
-        printf("%d: PID=%d, ", i + 1, history_log[i].pid);
-        printf("Start: ");
-        print_formatted_time(history_log[i].start_time);
-        printf(", Duration: %.4f s, ", history_log[i].execution_duration);
-        printf("Cmd: \"%s\"\n", history_log[i].cmd_str);
+    long long first = hist_hdr->total - HIST_CAPACITY > session_start ? hist_hdr->total - HIST_CAPACITY : session_start;
+    for (long long seq = first; seq < hist_hdr->total; seq++) {
+        cmdent* e = history_entry(seq);
+        if (e && e->owner == getpid()) {
+            print_entry(e);
+        }
+    }
+    printf("-----------------\n");
+}
+
+// built-in 'history -p <prefix>' and 'history -s <substring>': searches every entry in the ring, newest last.
+// the signature index rules out most entries without touching them.
+void search_history(const char* query, int prefix_only) {
+    unsigned long long qsig = trigram_sig(query);
+    size_t qlen = strlen(query);
+    long long first = hist_hdr->total > HIST_CAPACITY ? hist_hdr->total - HIST_CAPACITY : 0;
+    for (long long seq = first; seq < hist_hdr->total; seq++) {
+        if ((hist_sigs[seq % HIST_CAPACITY] & qsig) != qsig) {
+            continue;
+        }
+        cmdent* e = history_entry(seq);
+        if (e && (prefix_only ? strncmp(e->cmd_str, query, qlen) == 0 : strstr(e->cmd_str, query) != NULL)) {
+            print_entry(e);
+        }
+    }
+}
+
+// built-in 'history -a': count, mean and p95 duration per command over all sessions
+void display_history_stats() {
+    printf("\n--- Command Stats (%lld entries) ---\n", hist_hdr->total);
+    printf("%-20s %10s %12s %12s\n", "command", "count", "mean (s)", "p95 (s)");
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        cmd_stats* st = &hist_stats[b];
+        if (st->name[0] == '\0') {
+            continue;
+        }
+        long long target = (st->count * 95 + 99) / 100, seen = 0;
+        int bin = 0;
+        while (bin < DUR_BINS - 1 && seen + st->dur_bins[bin] < target) {
+            seen += st->dur_bins[bin++];
+        }
+        // interpolate within the bin, taking its durations as spread evenly between its edges, and keep
+        // it within the durations actually recorded: a bin is up to a fifth wide, so a command that was
+        // only run once reports its own duration rather than the bin's upper edge
+        double low = bin_seconds(bin), high = bin_upper_seconds(bin);
+        double p95 = st->dur_bins[bin] > 0 ? low + (high - low) * (target - seen) / st->dur_bins[bin] : low;
+        p95 = p95 < st->min_duration ? st->min_duration : p95 > st->max_duration ? st->max_duration : p95;
+        printf("%-20s %10lld %12.4f %12.4f\n", st->name, st->count, st->total_duration / st->count, p95);
     }
     printf("-----------------\n");
 }
@@ -66,87 +389,718 @@ void display_history() {
 //this function is called when the user presses Ctrl+C. It prints a message, displays the command history, and exits the shell gracefully.
  
 void handle_sigint(int sig) {
+    (void)sig; // Suppress unused parameter warning
     printf("\nCaught SIGINT. Displaying history and exiting.\n");
     display_history();
-    for (int i = 0; i < histc; i++) {     // free dynamically allocated memory in history
-        free(history_log[i].cmd_str);
-    }
     exit(0);
 }
 
-// uses fgets to prevent buffer overflows and removes the trailing newline character.
+// blocks SIGCHLD so the job table can be changed without racing handle_sigchld
+void block_sigchld(sigset_t* old) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, old);
+}
 
-char* read_cmdline() {
-    char* line = malloc(sizeof(char) * MAX_CMD_LEN);
-    if (!line) {
-        perror("malloc failed");
-        exit(EXIT_FAILURE);
+// converts a wait status into a shell exit code
+int exit_code(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return 0;
+}
+
+// reaps background jobs as soon as they change state. When the last process of a job is gone the job is
+// marked done and its history entry gets its real duration; the prompt loop prints the notification.
+void handle_sigchld(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    for (int j = 0; j < MAX_JOBS; j++) {
+        job* jb = &job_table[j];
+        if (jb->state != JOB_RUNNING && jb->state != JOB_STOPPED) {
+            continue;
+        }
+        int status;
+        pid_t pid;
+        struct rusage ru;
+        cmdent* e = history_entry(jb->hist_seq);
+        while ((pid = wait4(-jb->pgid, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru)) > 0) {
+            if (WIFSTOPPED(status)) {
+                jb->state = JOB_STOPPED;
+            } else if (WIFCONTINUED(status)) {
+                jb->state = JOB_RUNNING;
+            } else {
+                jb->nalive--;
+                if (pid == jb->last_pid) {
+                    jb->status = status;
+                }
+                for (int k = 0; e && k < e->nstages; k++) {
+                    if (e->stages[k].pid == pid) {
+                        record_usage(&e->stages[k], &ru, monotonic_now() - jb->start);
+                    }
+                }
+            }
+        }
+        if (jb->nalive == 0) {
+            if (e) {
+                e->execution_duration = monotonic_now() - jb->start;
+            }
+            jb->state = JOB_DONE;
+        }
+    }
+    errno = saved_errno;
+}
+
+// index of a free job_table slot, or -1 when MAX_JOBS jobs are active
+int find_free_job() {
+    for (int j = 0; j < MAX_JOBS; j++) {
+        if (job_table[j].state == JOB_FREE) {
+            return j;
+        }
     }
-    if (!fgets(line, MAX_CMD_LEN, stdin)) {
-        printf("\n"); 
+    return -1;
+}
+
+// registers a freshly forked background job, must be called with SIGCHLD blocked and a free slot available
+int add_job(pid_t pgid, pid_t last_pid, int nprocs, long long hist_seq, double start, char* cmd) {
+    int j = find_free_job();
+    job_table[j].pgid = pgid;
+    job_table[j].last_pid = last_pid;
+    job_table[j].nalive = nprocs;
+    job_table[j].status = 0;
+    job_table[j].hist_seq = hist_seq;
+    job_table[j].start = start;
+    job_table[j].cmd = strdup(cmd);
+    job_table[j].state = JOB_RUNNING;
+    printf("[%d] %d\n", j + 1, pgid);
+    return j + 1;
+}
+
+// prints and releases finished jobs, called before every prompt
+void notify_jobs() {
+    sigset_t old;
+    block_sigchld(&old);
+    for (int j = 0; j < MAX_JOBS; j++) {
+        if (job_table[j].state == JOB_DONE) {
+            printf("[%d]  Done (%d)\t%s\n", j + 1, exit_code(job_table[j].status), job_table[j].cmd);
+            finish_history(job_table[j].hist_seq);
+            free(job_table[j].cmd);
+            job_table[j].state = JOB_FREE;
+        }
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+// prepares a forked child: restores the signal state and, for background jobs, moves it into the job's
+// process group. non-interactive background jobs read /dev/null instead of the script.
+void setup_child(int background, pid_t pgid, int first_stage) {
+    signal(SIGTTOU, SIG_DFL);
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+    if (!background) {
+        return;
+    }
+    setpgid(0, pgid);
+    if (first_stage && !isatty(STDIN_FILENO)) {
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            close(null_fd);
+        }
+    }
+}
+
+// reads the next line into a buffer that is reused for every line and grows for long ones, so reading
+// allocates nothing once the longest line has been seen.
+char* read_cmdline() {
+    static char* line = NULL;
+    static size_t line_cap = 0;
+    ssize_t len = getline(&line, &line_cap, input);
+    if (len < 0) {
+        if (!script_mode) {
+            printf("\n"); 
+        }
         exit(0);
     }
     line[strcspn(line, "\n")] = 0; //remove trailing \n
     return line;
 }
 
-//uses strtok to tokenize the input string by spaces. The last element of the args array is set to NULL as required by execvp.
+// one command of a pipeline, after quotes, escapes and redirections have been resolved
+typedef struct {
+    char** argv;                // NULL-terminated words
+    int argc;
+    char* in_file;              // < file
+    char* out_file;             // > file or >> file
+    int append;                 // out_file was given with >>
+    char* here_string;          // <<< word, fed to stdin followed by a newline
+} parsed_stage;
+
+// stages joined by '|', ended by ';', '&&', '&' or the end of the line
+typedef struct {
+    parsed_stage* stages;
+    int nstages;
+    char* text;                 // source text of the pipeline, recorded in history
+    int background;             // ended by '&'
+    int and_next;               // ended by '&&', the next pipeline only runs if this one succeeds
+} parsed_pipeline;
+
+// every parse result of a line lives in one arena block. It is sized from the line length, which bounds the
+// number of words, stages and pipelines, and is only reallocated when a longer line arrives.
+typedef struct {
+    char* block;
+    size_t cap;
+    char* chars;                // unquoted word text and pipeline text
+    char** words;               // argv slices, each stage's argv ends with a NULL
+    parsed_stage* stages;
+    parsed_pipeline* pipelines;
+    int npipelines;
+} parse_arena;
+
+parse_arena arena;
+
+void arena_reset(size_t len) {
+    // a stage needs at least one word character and a separator, a word at least one character and a blank
+    size_t nwords = len + 4;             // words plus the NULL ending each stage's argv
+    size_t nstages = (len + 1) / 2 + 2;  // also bounds the pipelines
+    size_t need = nwords * sizeof(char*) + nstages * (sizeof(parsed_stage) + sizeof(parsed_pipeline)) + 4 * len + 16;
+    if (need > arena.cap) {
+        free(arena.block);
+        arena.cap = need * 2;
+        arena.block = malloc(arena.cap);
+        if (!arena.block) {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    // pointer-aligned regions first, then the characters
+    arena.words = (char**)arena.block;
+    arena.stages = (parsed_stage*)(arena.words + nwords);
+    arena.pipelines = (parsed_pipeline*)(arena.stages + nstages);
+    arena.chars = (char*)(arena.pipelines + nstages);
+    arena.npipelines = 0;
+}
+
+int is_operator(char c) {
+    return c == '|' || c == ';' || c == '&' || c == '<' || c == '>';
+}
+
+// reads one word starting at *p into out, removing quotes and escapes. Single quotes keep everything
+// literally; inside double quotes a backslash only escapes " \ $ and `. returns NULL on an unterminated quote.
+char* read_word(const char** p, char** out) {
+    const char* s = *p;
+    char* word = *out;
+    char* w = word;
+    while (*s && *s != ' ' && *s != '\t' && !is_operator(*s)) {
+        if (*s == '\\' && s[1]) {
+            *w++ = s[1];
+            s += 2;
+        } else if (*s == '\'') {
+            const char* close = strchr(s + 1, '\'');
+            if (!close) {
+                return NULL;
+            }
+            memcpy(w, s + 1, close - s - 1);
+            w += close - s - 1;
+            s = close + 1;
+        } else if (*s == '"') {
+            s++;
+            while (*s && *s != '"') {
+                if (*s == '\\' && (s[1] == '"' || s[1] == '\\' || s[1] == '$' || s[1] == '`')) {
+                    s++;
+                }
+                *w++ = *s++;
+            }
+            if (*s != '"') {
+                return NULL;
+            }
+            s++;
+        } else {
+            *w++ = *s++;
+        }
+    }
+    *w++ = '\0';
+    *p = s;
+    *out = w;
+    return word;
+}
+
+// single pass over a line that fills the arena with pipelines. Returns the number of pipelines, or -1 after
+// printing a syntax error. Nothing is allocated unless the line is longer than any line before it.
+int parse_line(const char* line) {
+    size_t len = strlen(line);
+    arena_reset(len);
+    char* chars = arena.chars;
+    int nwords = 0, nstages = 0;
+    const char* p = line;
+
+    while (1) {
+        // start a pipeline
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0' || *p == '#') {
+            break;
+        }
+        parsed_pipeline* pl = &arena.pipelines[arena.npipelines];
+        memset(pl, 0, sizeof(*pl));
+        pl->stages = &arena.stages[nstages];
+        const char* text_start = p;
+        const char* text_end = p;
+        int done = 0;
+        while (!done) {
+            // start a stage
+            parsed_stage* st = &arena.stages[nstages++];
+            memset(st, 0, sizeof(*st));
+            st->argv = &arena.words[nwords];
+            pl->nstages++;
+            while (1) {
+                while (*p == ' ' || *p == '\t') p++;
+                char c = *p;
+                if (c == '\0' || c == '#' || c == ';' || c == '&' || c == '|') {
+                    break;
+                }
+                char** target = NULL;
+                if (c == '<' && p[1] == '<' && p[2] == '<') {
+                    target = &st->here_string;
+                    p += 3;
+                } else if (c == '<') {
+                    target = &st->in_file;
+                    p++;
+                } else if (c == '>') {
+                    st->append = p[1] == '>';
+                    target = &st->out_file;
+                    p += st->append ? 2 : 1;
+                }
+                if (target) {
+                    while (*p == ' ' || *p == '\t') p++;
+                    if (*p == '\0' || is_operator(*p)) {
+                        fprintf(stderr, "syntax error: missing file name after redirection\n");
+                        return -1;
+                    }
+                }
+                char* word = read_word(&p, &chars);
+                if (!word) {
+                    fprintf(stderr, "syntax error: unterminated quote\n");
+                    return -1;
+                }
+                if (target) {
+                    *target = word;
+                } else {
+                    arena.words[nwords++] = word;
+                    st->argc++;
+                }
+                text_end = p;
+            }
+            arena.words[nwords++] = NULL;
+            if (st->argc == 0) {
+                fprintf(stderr, "syntax error: empty command\n");
+                return -1;
+            }
+            if (*p == '|' && p[1] != '|') {
+                p++;
+                continue;
+            }
+            if (*p == '|') {
+                fprintf(stderr, "syntax error: '||' is not supported\n");
+                return -1;
+            }
+            // end of the pipeline
+            if (*p == '&' && p[1] == '&') {
+                pl->and_next = 1;
+                p += 2;
+            } else if (*p == '&') {
+                pl->background = 1;
+                p++;
+            } else if (*p == ';') {
+                p++;
+            } else { // end of line or a comment
+                while (*p) p++;
+            }
+            done = 1;
+        }
+        pl->text = chars;
+        memcpy(chars, text_start, text_end - text_start);
+        chars += text_end - text_start;
+        *chars++ = '\0';
+        arena.npipelines++;
+    }
+    return arena.npipelines;
+}
+
+// plain read/write copy for the built-in stages, used when stdin or stdout is not a pipe
+long long copy_stage(int tee_fd) {
+    static char buf[1 << 16];
+    long long total = 0;
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+        if (write(STDOUT_FILENO, buf, n) != n || (tee_fd >= 0 && write(tee_fd, buf, n) != n)) {
+            perror("write failed");
+            _exit(EXIT_FAILURE);
+        }
+        total += n;
+    }
+    return total;
+}
+
+// built-in "cat" and "tee <file>" pipeline stages. The data is moved between pipes with splice, and tee
+// duplicates it without consuming, so the bytes never pass through user space. The kernel does not
+// splice into O_APPEND files, so "tee -a" reads the duplicated bytes and writes them to the file.
+// returns bytes written.
+long long splice_stage(char** args) {
+    static char buf[1 << 16];
+    int tee_fd = -1, append = 0;
+    if (strcmp(args[0], "tee") == 0) {
+        append = strcmp(args[1], "-a") == 0;
+        tee_fd = open(args[append ? 2 : 1], O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+        if (tee_fd < 0) {
+            perror("tee: open failed");
+            _exit(EXIT_FAILURE);
+        }
+    }
+    long long total = 0;
+    while (1) {
+        ssize_t n;
+        if (tee_fd >= 0) {
+            n = tee(STDIN_FILENO, STDOUT_FILENO, SPLICE_CHUNK, 0);
+            for (ssize_t left = n; left > 0; ) { // consume the duplicated bytes into the file
+                ssize_t m;
+                if (append) {
+                    m = read(STDIN_FILENO, buf, left < (ssize_t)sizeof(buf) ? left : (ssize_t)sizeof(buf));
+                    if (m > 0 && write(tee_fd, buf, m) != m) {
+                        m = -1;
+                    }
+                } else {
+                    m = splice(STDIN_FILENO, NULL, tee_fd, NULL, left, SPLICE_F_MOVE);
+                }
+                if (m <= 0) {
+                    perror(append ? "tee: write failed" : "tee: splice failed");
+                    _exit(EXIT_FAILURE);
+                }
+                left -= m;
+            }
+        } else {
+            n = splice(STDIN_FILENO, NULL, STDOUT_FILENO, NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        }
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINVAL && total == 0) { // one side is a terminal or not a pipe
+                total = copy_stage(tee_fd);
+                break;
+            }
+            perror("splice failed");
+            _exit(EXIT_FAILURE);
+        }
+        total += n;
+    }
+    if (tee_fd >= 0) {
+        close(tee_fd);
+    }
+    return total;
+}
+
+// a stage runs in the shell's own child instead of exec when it is a bare "cat" or "tee [-a] <file>"
+int is_splice_stage(char** args) {
+    if (args[0] == NULL) {
+        return 0;
+    }
+    if (strcmp(args[0], "cat") == 0) {
+        return args[1] == NULL;
+    }
+    if (strcmp(args[0], "tee") == 0 && args[1] != NULL) {
+        int append = strcmp(args[1], "-a") == 0;
+        return append ? (args[2] != NULL && args[3] == NULL) : args[2] == NULL;
+    }
+    return 0;
+}
+
+// bytes a finished but not yet reaped child wrote, taken from /proc/<pid>/io
+long long proc_write_bytes(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/io", pid);
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        return 0;
+    }
+    char line[128];
+    long long bytes = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "wchar: %lld", &bytes) == 1) {
+            break;
+        }
+    }
+    fclose(fp);
+    return bytes;
+}
+
+unsigned int hash_name(const char* name) {
+    unsigned int h = 5381;
+    while (*name) {
+        h = h * 33 + (unsigned char)*name++;
+    }
+    return h % PATH_CACHE_SIZE;
+}
+
+// built-in 'hash -r': forgets every cached path
+void clear_path_cache() {
+    for (int b = 0; b < PATH_CACHE_SIZE; b++) {
+        path_ent* e = path_cache[b];
+        while (e) {
+            path_ent* next = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            e = next;
+        }
+        path_cache[b] = NULL;
+    }
+}
+
+// resolves a command name to the executable execvp would run, searching PATH only on a cache miss.
+// names containing '/' are used as they are. returns NULL when the command is not found.
+const char* lookup_command(const char* name) {
+    if (strchr(name, '/')) {
+        return name;
+    }
+    const char* path_env = getenv("PATH");
+    if (path_env == NULL) {
+        path_env = "/usr/local/bin:/usr/bin:/bin";
+    }
+    if (cached_path_env == NULL || strcmp(cached_path_env, path_env) != 0) { // PATH changed, start over
+        clear_path_cache();
+        free(cached_path_env);
+        cached_path_env = strdup(path_env);
+    }
+    unsigned int b = hash_name(name);
+    for (path_ent* e = path_cache[b]; e; e = e->next) {
+        if (strcmp(e->name, name) == 0) {
+            e->hits++;
+            return e->path;
+        }
+    }
+    char candidate[MAX_CMD_LEN];
+    const char* dir = path_env;
+    while (1) {
+        size_t len = strcspn(dir, ":");
+        // an empty PATH element means the current directory
+        snprintf(candidate, sizeof(candidate), "%.*s/%s", len ? (int)len : 1, len ? dir : ".", name);
+        if (access(candidate, X_OK) == 0) {
+            path_ent* e = malloc(sizeof(path_ent));
+            e->name = strdup(name);
+            e->path = strdup(candidate);
+            e->hits = 1;
+            e->next = path_cache[b];
+            path_cache[b] = e;
+            return e->path;
+        }
+        if (dir[len] == '\0') {
+            return NULL;
+        }
+        dir += len + 1;
+    }
+}
+
+// built-in 'hash': shows the cached command paths
+void display_path_cache() {
+    printf("hits\tcommand\n");
+    for (int b = 0; b < PATH_CACHE_SIZE; b++) {
+        for (path_ent* e = path_cache[b]; e; e = e->next) {
+            printf("%4d\t%s\n", e->hits, e->path);
+        }
+    }
+}
+
+// opens a stage's redirections in the child before it runs. A here-string is written to a memfd so it can be
+// of any size without a helper process.
+void apply_redirections(parsed_stage* st) {
+    if (st->here_string) {
+        int fd = memfd_create("here-string", 0);
+        size_t n = strlen(st->here_string);
+        if (fd < 0 || write(fd, st->here_string, n) != (ssize_t)n || write(fd, "\n", 1) != 1 || lseek(fd, 0, SEEK_SET) < 0) {
+            perror("here-string failed");
+            _exit(EXIT_FAILURE);
+        }
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+    }
+    if (st->in_file) {
+        int fd = open(st->in_file, O_RDONLY);
+        if (fd < 0) {
+            perror(st->in_file);
+            _exit(EXIT_FAILURE);
+        }
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+    }
+    if (st->out_file) {
+        int fd = open(st->out_file, O_WRONLY | O_CREAT | (st->append ? O_APPEND : O_TRUNC), 0644);
+        if (fd < 0) {
+            perror(st->out_file);
+            _exit(EXIT_FAILURE);
+        }
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+}
 
-void parse_arguments(char* line, char** args) {
-    int i = 0;
-    char* token = strtok(line, " ");
-    while (token != NULL && i < MAX_ARGS - 1) {
-        args[i++] = token;
-        token = strtok(NULL, " ");
+// exec for a forked child, using the path resolved by the parent. failures use _exit: exit() would
+// flush the inherited script stream and move the shared file offset under the parent.
+void exec_resolved(const char* path, char** args) {
+    if (path == NULL) {
+        fprintf(stderr, "%s: command not found\n", args[0]);
+        _exit(127);
     }
-    args[i] = NULL;
+    execv(path, args);
+    perror("execv failed");
+    _exit(EXIT_FAILURE);
+}
+
+// posix_spawn fast path for simple commands. glibc implements it with clone(CLONE_VM | CLONE_VFORK), so
+// a shell with a large resident set does not pay for copying its page tables the way fork() does.
+pid_t spawn_cmd(const char* path, parsed_stage* st, int background) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+
+    // same child state as setup_child(): empty signal mask, SIGTTOU back to default
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigaddset(&mask, SIGTTOU);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    if (background) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, 0);
+        if (!isatty(STDIN_FILENO)) {
+            posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        }
+    }
+    posix_spawnattr_setflags(&attr, flags);
+    if (st->in_file) { // here-strings are never spawned, see exec_cmd
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, st->in_file, O_RDONLY, 0);
+    }
+    if (st->out_file) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, st->out_file,
+                                         O_WRONLY | O_CREAT | (st->append ? O_APPEND : O_TRUNC), 0644);
+    }
+
+    pid_t pid;
+    int err = posix_spawn(&pid, path, &actions, &attr, st->argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (err != 0) {
+        fprintf(stderr, "posix_spawn failed: %s\n", strerror(err));
+        return -1;
+    }
+    return pid;
 }
 
 // this function forks a new process. The child process executes the command using execvp. The parent process waits for the child to complete, records the execution time, 
-// and adds the command to the history.
+// and adds the command to the history. Background commands are registered as a job instead and return at once.
 
-void exec_cmd(char** args, char* og_cmd) {
-    struct timeval start, end;
+int exec_cmd(parsed_stage* st, char* og_cmd, int background) {
+    double start;
     pid_t pid;
-    gettimeofday(&start, NULL);
-    pid = fork();
-    if (pid == -1) {
-        perror("fork failed");
-        return;
-    } else if (pid == 0) { // child process
-        if (execvp(args[0], args) == -1) {
-            perror("execvp failed");
-            exit(EXIT_FAILURE);
+    sigset_t old;
+    const char* path = lookup_command(st->argv[0]);
+    start = monotonic_now();
+    block_sigchld(&old); // the job must be in the table before its SIGCHLD is handled
+    fflush(stdout); // the child must not inherit or overtake unflushed output
+    if (use_spawn && path != NULL && st->here_string == NULL) {
+        pid = spawn_cmd(path, st, background);
+        if (pid == -1) {
+            sigprocmask(SIG_SETMASK, &old, NULL);
+            return 1;
         }
     } else {
-        // Parent process
-        int status;
-        waitpid(pid, &status, 0);
-        gettimeofday(&end, NULL);
-        add_to_history(og_cmd, pid, start, end);
+        pid = fork();
+        if (pid == -1) {
+            perror("fork failed");
+            sigprocmask(SIG_SETMASK, &old, NULL);
+            return 1;
+        } else if (pid == 0) { // child process
+            setup_child(background, 0, 1);
+            apply_redirections(st);
+            exec_resolved(path, st->argv);
+        }
+    }
+    // Parent process
+    if (background) {
+        setpgid(pid, pid);
+        long long seq = add_to_history(og_cmd, pid, start, start);
+        cmdent* e = history_entry(seq);
+        e->nstages = 1;
+        e->stages[0].pid = pid;
+        add_job(pid, pid, 1, seq, start, og_cmd);
+        sigprocmask(SIG_SETMASK, &old, NULL);
+        return 0;
     }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    int status;
+    struct rusage ru;
+    wait4(pid, &status, 0, &ru);
+    double end = monotonic_now();
+    cmdent* e = history_entry(add_to_history(og_cmd, pid, start, end));
+    e->nstages = 1;
+    e->stages[0].pid = pid;
+    record_usage(&e->stages[0], &ru, end - start);
+    return exit_code(status);
 }
 
 
+// undoes a pipeline that failed part-way through starting: closes the pipe end waiting for the next stage,
+// stops and reaps the stages already forked (the first one may be waiting on the terminal) and frees the
+// byte counters. SIGCHLD is still blocked, so handle_sigchld cannot reap them first. returns 1
+int abort_pipeline(pid_t* pids, int started, int input_fd, long long* splice_bytes, int num_commands, sigset_t* old) {
+    if (input_fd != STDIN_FILENO) {
+        close(input_fd);
+    }
+    for (int i = 0; i < started; i++) {
+        kill(pids[i], SIGTERM);
+    }
+    for (int i = 0; i < started; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+    sigprocmask(SIG_SETMASK, old, NULL);
+    munmap(splice_bytes, sizeof(long long) * num_commands);
+    return 1;
+}
+
 // this function handles both single commands with pipes and multiple pipes. It creates a chain of child processes and connects their standard I/O using pipes.
 
-void exec_pipecmd(char* command) {
-    char* original_command = strdup(command);
-    char* commands[MAX_ARGS];
-    int num_commands = 0;
-    
-    // 1. Split the command string by '|' to get individual commands
-    char* token = strtok(command, "|");
-    while(token != NULL) {
-        commands[num_commands++] = token;
-        token = strtok(NULL, "|");
-    }
+int exec_pipecmd(parsed_pipeline* pl) {
+    // 1. The parser has already split the line into stages
+    char* original_command = pl->text;
+    int num_commands = pl->nstages;
+    int background = pl->background;
 
-    struct timeval start, end;
-    gettimeofday(&start, NULL);
+    double start = monotonic_now();
 
     int input_fd = STDIN_FILENO; // The input for the first command is stdin
     pid_t pids[num_commands];
+    pid_t last_pid = 0; // the pipeline's pid in history and the job table
+
+    // built-in stages report their byte counts here, it is shared with the children
+    long long* splice_bytes = mmap(NULL, sizeof(long long) * num_commands, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (splice_bytes == MAP_FAILED) {
+        perror("mmap failed");
+        return 1;
+    }
+    for (int i = 0; i < num_commands; i++) {
+        splice_bytes[i] = -1;
+    }
+    fflush(stdout); // built-in stages return through exit(), which must not replay the prompt into the pipe
+    pid_t pgid = 0; // background pipelines share the process group of their first stage
+    sigset_t old;
+    block_sigchld(&old);
 
     // 2. Loop through each command and set up the pipeline
     for (int i = 0; i < num_commands; i++) {
@@ -156,20 +1110,30 @@ void exec_pipecmd(char* command) {
         if (i < num_commands - 1) {
             if (pipe(pipefd) == -1) {
                 perror("pipe failed");
-                free(original_command);
-                return;
+                return abort_pipeline(pids, i, input_fd, splice_bytes, num_commands, &old);
+            }
+            // a larger pipe lets bulk stages move more per wakeup; failure (e.g. above pipe-max-size) keeps the default
+            if (pipe_capacity > 0) {
+                fcntl(pipefd[1], F_SETPIPE_SZ, pipe_capacity);
             }
         }
 
+        char** args = pl->stages[i].argv;
+        const char* path = lookup_command(args[0]); // resolved in the parent so the path cache is kept across commands
+
         pids[i] = fork();
         if (pids[i] < 0) {
             perror("fork failed");
-            free(original_command);
-            return;
+            if (i < num_commands - 1) {
+                close(pipefd[0]);
+                close(pipefd[1]);
+            }
+            return abort_pipeline(pids, i, input_fd, splice_bytes, num_commands, &old);
         }
 
         if (pids[i] == 0) {
             // child
+            setup_child(background, pgid, i == 0);
             if (input_fd != STDIN_FILENO) { // redirect input if it's not the first command
                 dup2(input_fd, STDIN_FILENO);
                 close(input_fd);
@@ -183,15 +1147,22 @@ void exec_pipecmd(char* command) {
                 close(pipefd[1]);
             }
             
-            char* args[MAX_ARGS]; // parse and execute the current command
-            parse_arguments(commands[i], args);
-            if (execvp(args[0], args) == -1) {
-                perror("execvp failed");
-                exit(EXIT_FAILURE);
+            apply_redirections(&pl->stages[i]);
+            if (is_splice_stage(args)) {
+                splice_bytes[i] = splice_stage(args);
+                _exit(EXIT_SUCCESS);
             }
+            exec_resolved(path, args);
         } 
         else {
             //parent
+            last_pid = pids[i];
+            if (background) {
+                if (pgid == 0) {
+                    pgid = pids[i];
+                }
+                setpgid(pids[i], pgid);
+            }
             // Close the previous input FD if it's not stdin
             if (input_fd != STDIN_FILENO) {
                 close(input_fd);
@@ -204,68 +1175,317 @@ void exec_pipecmd(char* command) {
             }
         }
     }
-    // 3. Wait for all child processes to finish
-    for (int i = 0; i < num_commands; i++) {
-        waitpid(pids[i], NULL, 0);
+    if (background) { // handle_sigchld reaps the stages, per-stage byte counts are not collected
+        long long seq = add_to_history(original_command, last_pid, start, start);
+        cmdent* e = history_entry(seq);
+        e->nstages = num_commands < MAX_STAGES ? num_commands : MAX_STAGES;
+        for (int i = 0; i < e->nstages; i++) {
+            e->stages[i].pid = pids[i];
+        }
+        add_job(pgid, last_pid, num_commands, seq, start, original_command);
+        sigprocmask(SIG_SETMASK, &old, NULL);
+        munmap(splice_bytes, sizeof(long long) * num_commands);
+        return 0;
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+
+    // 3. Wait for all child processes to finish, in the order they exit. The foreground stages are the only
+    // children in the shell's process group. Each one is first waited on with WNOWAIT so its /proc/<pid>/io
+    // counters can still be read, then reaped with wait4 to collect its resource usage
+    stage_usage usage[num_commands];
+    memset(usage, 0, sizeof(usage));
+    int status = 0;
+    for (int left = num_commands; left > 0; left--) {
+        siginfo_t info;
+        if (waitid(P_PGID, getpgrp(), &info, WEXITED | WNOWAIT) == -1) {
+            break;
+        }
+        int i = 0;
+        while (i < num_commands && pids[i] != info.si_pid) i++;
+        struct rusage ru;
+        int st;
+        if (i == num_commands) { // not one of ours, should not happen
+            wait4(info.si_pid, &st, 0, &ru);
+            left++;
+            continue;
+        }
+        usage[i].pid = pids[i];
+        usage[i].bytes_out = splice_bytes[i] >= 0 ? splice_bytes[i] : proc_write_bytes(pids[i]);
+        wait4(pids[i], &st, 0, &ru);
+        record_usage(&usage[i], &ru, monotonic_now() - start);
+        if (i == num_commands - 1) {
+            status = st; // like other shells, the pipeline's status is the last stage's
+        }
     }
-    gettimeofday(&end, NULL);
+    double end = monotonic_now();
     
     // Add to history, using the PID of the last command in the pipeline
-    add_to_history(original_command, pids[num_commands - 1], start, end);
-    free(original_command);
+    cmdent* e = history_entry(add_to_history(original_command, last_pid, start, end));
+    if (e) {
+        e->nstages = num_commands < MAX_STAGES ? num_commands : MAX_STAGES;
+        memcpy(e->stages, usage, e->nstages * sizeof(stage_usage));
+    }
+    munmap(splice_bytes, sizeof(long long) * num_commands);
+    return exit_code(status);
 }
 
-// continuously displays a prompt, reads user input, and dispatches the command for execution, handling builtin commands like 'history' and 'exit'.
+// finds a job from a "%n" or "n" argument, or the most recent job when none is given. returns its index or -1.
+int find_job(char* spec) {
+    if (spec == NULL) {
+        for (int j = MAX_JOBS - 1; j >= 0; j--) {
+            if (job_table[j].state != JOB_FREE) {
+                return j;
+            }
+        }
+        return -1;
+    }
+    if (*spec == '%') {
+        spec++;
+    }
+    int n = atoi(spec);
+    if (n < 1 || n > MAX_JOBS || job_table[n - 1].state == JOB_FREE) {
+        return -1;
+    }
+    return n - 1;
+}
 
-void shell_loop() {
-    char* line;
-    char* args[MAX_ARGS];
-    char* line_copy_for_history;
+// built-in 'jobs': lists the background jobs
+void list_jobs() {
+    static const char* state_names[] = {"Free", "Running", "Stopped", "Done"};
+    sigset_t old;
+    block_sigchld(&old);
+    for (int j = 0; j < MAX_JOBS; j++) {
+        if (job_table[j].state != JOB_FREE) {
+            printf("[%d]  %-8s %d\t%s\n", j + 1, state_names[job_table[j].state], job_table[j].pgid, job_table[j].cmd);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
 
-    signal(SIGINT, handle_sigint);
+// built-ins 'fg' and 'bg': resume a job with SIGCONT. fg hands it the terminal and waits until it finishes or stops again.
+int resume_job(char* spec, int foreground) {
+    sigset_t old;
+    block_sigchld(&old);
+    int j = find_job(spec);
+    if (j < 0 || job_table[j].state == JOB_DONE) {
+        fprintf(stderr, "%s: no such job\n", foreground ? "fg" : "bg");
+        sigprocmask(SIG_SETMASK, &old, NULL);
+        return 1;
+    }
+    job* jb = &job_table[j];
+    int interactive = isatty(STDIN_FILENO);
+    if (foreground) {
+        printf("%s\n", jb->cmd);
+        if (interactive) {
+            tcsetpgrp(STDIN_FILENO, jb->pgid);
+        }
+    } else {
+        printf("[%d] %s &\n", j + 1, jb->cmd);
+    }
+    kill(-jb->pgid, SIGCONT);
+    jb->state = JOB_RUNNING;
+    if (!foreground) {
+        sigprocmask(SIG_SETMASK, &old, NULL);
+        return 0;
+    }
+    while (jb->state == JOB_RUNNING) {
+        sigsuspend(&old); // handle_sigchld runs here and updates the job
+    }
+    if (interactive) {
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+    }
+    int code = 0;
+    if (jb->state == JOB_DONE) { // finished in the foreground, no notification needed
+        code = exit_code(jb->status);
+        finish_history(jb->hist_seq);
+        free(jb->cmd);
+        jb->state = JOB_FREE;
+    } else {
+        printf("\n[%d]  Stopped\t%s\n", j + 1, jb->cmd);
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return code;
+}
 
-    while (1) {
-        printf("ospansu:~$ ");
-        line = read_cmdline();
+// built-in 'wait': blocks until every running background job (or the given one) has finished
+int wait_jobs(char* spec) {
+    sigset_t old;
+    block_sigchld(&old);
+    int code = 0;
+    if (spec != NULL) {
+        int j = find_job(spec);
+        if (j < 0) {
+            fprintf(stderr, "wait: no such job\n");
+            sigprocmask(SIG_SETMASK, &old, NULL);
+            return 1;
+        }
+        while (job_table[j].state == JOB_RUNNING) {
+            sigsuspend(&old);
+        }
+        code = exit_code(job_table[j].status);
+    } else {
+        for (int j = 0; j < MAX_JOBS; j++) {
+            while (job_table[j].state == JOB_RUNNING) {
+                sigsuspend(&old);
+            }
+        }
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    notify_jobs();
+    return code;
+}
 
-        if (strlen(line) == 0) {
-            free(line);
-            continue;
+// runs one parsed pipeline. Built-ins are only recognised as a single stage and run in the shell itself.
+int run_pipeline(parsed_pipeline* pl) {
+    parsed_stage* st = &pl->stages[0];
+    char** args = st->argv;
+    char* arg = args[1];
+    int builtin = pl->nstages == 1;
+    int code = 0;
+    if (builtin && strcmp(args[0], "exit") == 0) {
+        shell_exit = 1;
+    } else if (builtin && strcmp(args[0], "history") == 0 && arg && strcmp(arg, "--stats") == 0) {
+        display_usage_stats();
+    } else if (builtin && strcmp(args[0], "history") == 0 && arg && strcmp(arg, "-a") == 0) {
+        display_history_stats();
+    } else if (builtin && strcmp(args[0], "history") == 0 && arg && (strcmp(arg, "-p") == 0 || strcmp(arg, "-s") == 0) && args[2]) {
+        search_history(args[2], arg[1] == 'p');
+    } else if (builtin && strcmp(args[0], "history") == 0 && !arg) {
+        // for the built-in 'history', we don't fork, so we manually create a history entry
+        double start = monotonic_now();
+        display_history();
+        add_to_history(pl->text, getpid(), start, monotonic_now());
+    } else if (builtin && strcmp(args[0], "pipesize") == 0) {
+        // built-in 'pipesize [bytes]' shows or sets the pipeline pipe capacity, 0 restores the kernel default
+        if (arg) {
+            pipe_capacity = atoi(arg);
         }
-        line_copy_for_history = strdup(line);// handle built-in commands
-        if (strcmp(line, "exit") == 0) { 
-            free(line); 
-            free(line_copy_for_history);
-            break;
+        printf("pipe capacity: %d bytes%s\n", pipe_capacity, pipe_capacity == 0 ? " (kernel default)" : "");
+    } else if (builtin && strcmp(args[0], "hash") == 0 && !arg) {
+        display_path_cache();
+    } else if (builtin && strcmp(args[0], "hash") == 0 && strcmp(arg, "-r") == 0) {
+        clear_path_cache();
+    } else if (builtin && strcmp(args[0], "spawn") == 0) {
+        // built-in 'spawn [on|off]' switches simple commands between fork and posix_spawn
+        if (arg) {
+            use_spawn = strcmp(arg, "on") == 0;
         }
+        printf("spawn: %s\n", use_spawn ? "on" : "off");
+    } else if (builtin && strcmp(args[0], "jobs") == 0) {
+        list_jobs();
+    } else if (builtin && strcmp(args[0], "fg") == 0) {
+        code = resume_job(arg, 1);
+    } else if (builtin && strcmp(args[0], "bg") == 0) {
+        code = resume_job(arg, 0);
+    } else if (builtin && strcmp(args[0], "wait") == 0) {
+        code = wait_jobs(arg);
+    } else if (pl->background && find_free_job() < 0) {
+        fprintf(stderr, "too many background jobs\n");
+        code = 1;
+    } else if (pl->nstages > 1) {
+        code = exec_pipecmd(pl);
+    } else {
+        code = exec_cmd(st, pl->text, pl->background);
+    }
+    return code;
+}
 
-        if (strcmp(line, "history") == 0) {
-            // for the built-in 'history', we don't fork, so we manually create a history entry
-            struct timeval start, end;
-            gettimeofday(&start, NULL);
-            display_history();
-            gettimeofday(&end, NULL);
-            add_to_history(line_copy_for_history, getpid(), start, end);
-            free(line);
-            free(line_copy_for_history);
-            continue;
+// parses a whole line, then runs its pipelines. '&' runs the preceding pipeline in the background, '&&' skips
+// the next pipeline when the previous one failed, ';' just runs them one after the other.
+void run_line(char* line) {
+    int n = parse_line(line);
+    int code = 0;
+    int skip = 0;
+    for (int i = 0; i < n && !shell_exit; i++) {
+        parsed_pipeline* pl = &arena.pipelines[i];
+        if (!skip) {
+            code = run_pipeline(pl);
         }
-        if (strchr(line, '|')) {
-            exec_pipecmd(line);
+        skip = pl->and_next && code != 0;
+    }
+}
+
+// --parse-bench: parses every line of a file without running anything and reports the parser throughput.
+// Used by bench.sh and by 'make fuzz', which feeds it random bytes.
+int parse_bench(const char* file) {
+    input = fopen(file, "r");
+    if (!input) {
+        perror("cannot open file");
+        return EXIT_FAILURE;
+    }
+    script_mode = 1;
+    long lines = 0, bytes = 0, pipelines = 0, errors = 0;
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int devnull = open("/dev/null", O_WRONLY); // syntax errors are counted, not printed
+    int saved_err = dup(STDERR_FILENO);
+    dup2(devnull, STDERR_FILENO);
+    double start = monotonic_now();
+    while ((len = getline(&line, &cap, input)) >= 0) {
+        line[strcspn(line, "\n")] = 0;
+        int n = parse_line(line);
+        if (n < 0) {
+            errors++;
         } else {
-            parse_arguments(line, args);
-            exec_cmd(args, line_copy_for_history);
+            pipelines += n;
         }
-        free(line);
-        free(line_copy_for_history);
+        lines++;
+        bytes += len;
+    }
+    double secs = monotonic_now() - start;
+    dup2(saved_err, STDERR_FILENO);
+    if (secs <= 0) {
+        secs = 1e-9;
     }
+    printf("%ld lines, %ld pipelines, %ld syntax errors in %.3f s: %.0f lines/s, %.1f MB/s\n",
+           lines, pipelines, errors, secs, lines / secs, bytes / secs / 1e6);
+    free(line);
+    return EXIT_SUCCESS;
 }
 
-//main entry point of the program.
-int main() {
-    shell_loop();
-    for (int i = 0; i < histc; i++) { //clean up allocated memory before exiting normally
-        free(history_log[i].cmd_str);
+// continuously displays a prompt, reads user input, and dispatches the command for execution, handling builtin commands like 'history' and 'exit'.
+
+void shell_loop() {
+    char* line;
+
+    signal(SIGINT, handle_sigint);
+    signal(SIGTTOU, SIG_IGN); // lets fg move the terminal between process groups
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigchld;
+    sa.sa_flags = SA_RESTART; // foreground waitpid and fgets resume after a background job is reaped
+    sigaction(SIGCHLD, &sa, NULL);
+
+    while (!shell_exit) {
+        notify_jobs();
+        if (!script_mode) {
+            printf("ospansu:~$ ");
+        }
+        line = read_cmdline(); // reused buffer, comments and a #! line in scripts are dropped by the parser
+        run_line(line);
+    }
+}
+
+//main entry point of the program. With a file argument the shell runs it as a script instead of reading commands interactively.
+int main(int argc, char** argv) {
+    input = stdin;
+    if (argc == 3 && strcmp(argv[1], "--parse-bench") == 0) {
+        return parse_bench(argv[2]);
     }
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [script | --parse-bench file]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (argc == 2) {
+        input = fopen(argv[1], "r");
+        if (!input) {
+            perror("cannot open script");
+            return EXIT_FAILURE;
+        }
+        script_mode = 1;
+    }
+    init_history();
+    shell_loop();
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Scheduler benchmark. Run with "make bench", or ./bench.sh [jobs] [arrivals_per_second].
+# Submits the same mix of workload jobs (cpu, mem, io, bursty and interactive profiles) to the shell
+# with exponential gaps between arrivals, for each policy and NCPU/TSLICE setting, and prints the
+# throughput, turnaround p50/p99 and Jain's fairness index from the shell's summary.
+JOBS=${1:-24}
+RATE=${2:-4}
+
+mix() {
+    awk -v n="$JOBS" -v rate="$RATE" 'BEGIN {
+        srand(7)
+        np = split("cpu 200|cpu 30|mem 100|io 100|bursty 80 20|interactive 20 10", profile, "|")
+        for (i = 0; i < n; i++) {
+            print "submit ./workload " profile[1 + int(rand() * np)]
+            fflush()
+            system("sleep " (-log(1 - rand()) / rate))
+        }
+        print "exit"
+    }'
+}
+
+# sjf starts from the predictions the rr runs of the same mix leave behind
+rm -f predictions.table
+printf "%-6s %4s %6s %8s %8s %8s %7s\n" policy ncpu tslice jobs/s p50_ms p99_ms jain
+for policy in rr sjf; do
+    for ncpu in 1 2; do
+        for tslice in 10 50; do
+            mix | ./shell --policy=$policy $ncpu $tslice 2>/dev/null | awk -v p=$policy -v c=$ncpu -v t=$tslice '
+                /^--- Job History ---/ { history = 1 }
+                history && /^Finished jobs:/ { jobs_s = $5 }
+                history && /^Turnaround: p50/ { p50 = $3; p99 = $6 }
+                history && /^Jain fairness index:/ { jain = $4 }
+                END { printf "%-6s %4s %6s %8s %8s %8s %7s\n", p, c, t, jobs_s, p50, p99, jain }'
+        done
+    done
+done
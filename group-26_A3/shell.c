@@ -6,9 +6,13 @@
 #include <signal.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <errno.h>
 
 #define MAX_CMD_LEN 1024
-#define MAX_JOBS 100
+#define MAX_ARGS 32
+#define MAX_JOBS 100000
+#define NPRIO 64 // priorities 0 (highest) to NPRIO - 1
+#define DEFAULT_PRIO 1
 
 typedef struct {
     int ncpu;
@@ -20,7 +24,13 @@ typedef struct {
     int job_completion_time[MAX_JOBS];
     int job_wait_time[MAX_JOBS];
     int job_finished[MAX_JOBS];
+    int job_priority[MAX_JOBS];
+    int job_arrival_ms[MAX_JOBS]; // scheduler clock when the job was admitted and when it finished
+    int job_finish_ms[MAX_JOBS];
     int shutdown;
+    int policy; // 0 round robin, 1 shortest predicted job first
+    int backend; // 0 SIGSTOP/SIGCONT every slice, 1 cgroup v2 cpu controller
+    int adaptive; // TSLICE is a target latency and the scheduler picks each slice length
 } scheduler_data;
 
 // global variables for scheduler interaction
@@ -33,27 +43,42 @@ void cleanup();
 void handle_sigint(int sig) {
     (void)sig; // Suppress unused parameter warning
     printf("\nCaught SIGINT. Shutting down gracefully...\n");
+    // jobs run in their own process groups, so pass the interrupt on like the terminal would
+    for (int i = 0; sched_data != NULL && i < sched_data->jobc; i++) {
+        if (!sched_data->job_finished[i]) {
+            kill(-sched_data->job_pids[i], SIGINT);
+        }
+    }
     cleanup();
     exit(0);
 }
 
+// reaps finished jobs so the scheduler's kill(pid, 0) check stops seeing them as zombies
+void handle_sigchld(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    while (waitpid(-1, NULL, WNOHANG) > 0);
+    errno = saved_errno;
+}
+
 char* read_cmdline() {
     char* line = malloc(sizeof(char) * MAX_CMD_LEN);
     if (!line) {
         perror("malloc failed");
         exit(EXIT_FAILURE);
     }
-    // if (!fgets(line, MAX_CMD_LEN, stdin)) {
-    //     printf("\n"); // Handle Ctrl+D (EOF)
-    //     cleanup();
-    //     exit(0);
-    // }
+    if (!fgets(line, MAX_CMD_LEN, stdin)) {
+        printf("\n"); // Handle Ctrl+D (EOF)
+        cleanup();
+        exit(0);
+    }
     line[strcspn(line, "\n")] = 0; // remove trailing newline
     return line;
 }
 
 
-void submit_job(char* executable) {
+// args is the job's argv, the whole command line is its name, which also keys its burst prediction
+void submit_job(char** args, int priority) {
     if (sched_data->jobc >= MAX_JOBS) {
         fprintf(stderr, "Error: Maximum job limit reached.\n");
         return;
@@ -66,26 +91,34 @@ void submit_job(char* executable) {
     }
     
     if (pid == 0) {
-        // fork child process 
-        char* args[] = {executable, NULL};
+        // fork child process, leading its own process group so the scheduler can stop and
+        // continue it together with every worker it forks
+        setpgid(0, 0);
         execv(args[0], args);
         perror("execv failed"); // if execv fails
         exit(EXIT_FAILURE);
     } else {
+        setpgid(pid, pid); // also here, so the group exists before the scheduler sees the job
         // record new job
         int job_idx = sched_data->jobc;
         sched_data->job_pids[job_idx] = pid;
-        strncpy(sched_data->job_names[job_idx], executable, 255);
-        sched_data->job_names[job_idx][255] = '\0';
-        sched_data->jobc++;
+        char* name = sched_data->job_names[job_idx];
+        name[0] = '\0';
+        for (int i = 0; args[i] != NULL; i++) {
+            if (i > 0) strncat(name, " ", 255 - strlen(name));
+            strncat(name, args[i], 255 - strlen(name));
+        }
+        sched_data->job_priority[job_idx] = priority;
+        sched_data->jobc++; // published last, the scheduler reads the job once it sees the new count
         
-        printf("Job '%s' submitted with PID %d.\n", executable, pid);
+        printf("Job '%s' submitted with PID %d, priority %d.\n", name, pid, priority);
     }
 }
 
 void shell_loop() {
     char* line;
     signal(SIGINT, handle_sigint);
+    signal(SIGCHLD, handle_sigchld);
 
     while (1) {
         printf("ospansu!$ ");
@@ -102,15 +135,32 @@ void shell_loop() {
         }
 
         if (strncmp(line, "submit ", 7) == 0) {
-            char* executable = line + 7;
-            while (*executable == ' ') executable++; 
-            if (strlen(executable) > 0) {
-                 submit_job(executable);
+            // submit [-p priority] <executable> [args...], or the older submit <executable> <priority>
+            char* args[MAX_ARGS + 1];
+            int nargs = 0, priority = DEFAULT_PRIO, ok = 1;
+            for (char* tok = strtok(line + 7, " "); tok != NULL; tok = strtok(NULL, " ")) {
+                if (nargs == MAX_ARGS) {
+                    ok = 0;
+                    break;
+                }
+                args[nargs++] = tok;
+            }
+            args[nargs] = NULL;
+            char** argp = args;
+            if (nargs >= 2 && strcmp(args[0], "-p") == 0) {
+                priority = atoi(args[1]);
+                argp += 2;
+            } else if (nargs == 2 && strspn(args[1], "0123456789") == strlen(args[1])) {
+                priority = atoi(args[1]);
+                args[1] = NULL;
+            }
+            if (ok && argp[0] != NULL && priority >= 0 && priority < NPRIO) {
+                 submit_job(argp, priority);
             } else {
-                 fprintf(stderr, "Usage: submit <path_to_executable>\n");
+                 fprintf(stderr, "Usage: submit [-p priority 0-%d] <path_to_executable> [args...]\n", NPRIO - 1);
             }
         } else {
-            fprintf(stderr, "Unknown command. Use 'submit <executable>' or 'exit'.\n");
+            fprintf(stderr, "Unknown command. Use 'submit [-p priority] <executable> [args...]' or 'exit'.\n");
 
         }
         
@@ -118,7 +168,7 @@ void shell_loop() {
     }
 }
 
-void init_scheduler(int ncpu, int tslice) {
+void init_scheduler(int ncpu, int tslice, int policy, int backend, int adaptive, char* trace_file) {
     // create a key for the shm
     key_t key = ftok("shell.c", 'S');
     if (key == -1) {
@@ -145,6 +195,9 @@ void init_scheduler(int ncpu, int tslice) {
     sched_data->tslice = tslice;
     sched_data->jobc = 0;
     sched_data->shutdown = 0;
+    sched_data->policy = policy;
+    sched_data->backend = backend;
+    sched_data->adaptive = adaptive;
 
     // fork and start the scheduler process.
     scheduler_pid = fork();
@@ -153,7 +206,11 @@ void init_scheduler(int ncpu, int tslice) {
         exit(1);
     } else if (scheduler_pid == 0) {
         // Child process becomes the scheduler.
-        execl("./simplescheduler", "simplescheduler", NULL);
+        if (trace_file != NULL) {
+            execl("./simplescheduler", "simplescheduler", "--record", trace_file, NULL);
+        } else {
+            execl("./simplescheduler", "simplescheduler", NULL);
+        }
         perror("execl for scheduler failed"); 
         exit(1);
     }
@@ -161,6 +218,41 @@ void init_scheduler(int ncpu, int tslice) {
     usleep(100000); // give scheduler time to initialize.
 }
 
+int cmp_int(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// throughput, turnaround percentiles and fairness of the finished jobs, from the scheduler's clock
+void print_summary() {
+    int n = 0, first = -1, last = 0;
+    int* turnaround = malloc(sizeof(int) * (sched_data->jobc + 1));
+    double share = 0, share2 = 0;
+    if (turnaround == NULL) {
+        perror("malloc failed");
+        return;
+    }
+    for (int i = 0; i < sched_data->jobc; i++) {
+        if (!sched_data->job_finished[i]) {
+            continue;
+        }
+        int t = sched_data->job_finish_ms[i] - sched_data->job_arrival_ms[i];
+        turnaround[n++] = t;
+        if (first < 0 || sched_data->job_arrival_ms[i] < first) first = sched_data->job_arrival_ms[i];
+        if (sched_data->job_finish_ms[i] > last) last = sched_data->job_finish_ms[i];
+        double x = t > 0 ? (double)sched_data->job_completion_time[i] * sched_data->tslice / t : 1.0;
+        x = x > 1.0 ? 1.0 : x; // share of its lifetime the job ran
+        share += x;
+        share2 += x * x;
+    }
+    if (n > 0) {
+        qsort(turnaround, n, sizeof(int), cmp_int);
+        printf("Finished jobs: %d, throughput: %.2f jobs/s\n", n, last > first ? n * 1000.0 / (last - first) : 0.0);
+        printf("Turnaround: p50 %d ms, p99 %d ms\n", turnaround[(n + 1) / 2 - 1], turnaround[(99 * n + 99) / 100 - 1]);
+        printf("Jain fairness index: %.4f\n", share2 > 0 ? share * share / (n * share2) : 1.0);
+    }
+    free(turnaround);
+}
+
 void cleanup() {
     if (sched_data != NULL) {
         printf("Initiating shutdown. Waiting for all jobs to complete...\n");
@@ -181,6 +273,7 @@ void cleanup() {
                    completion, sched_data->job_wait_time[i]);
         }
         printf("----------------------\n");
+        print_summary();
 
         shmdt(sched_data);
         shmctl(shmid, IPC_RMID, NULL);
@@ -188,8 +281,31 @@ void cleanup() {
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <NCPU> <TSLICE_ms>\n", argv[0]);
+    int policy = 0;
+    int backend = 0;
+    int adaptive = 0;
+    // options come before NCPU
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--policy=rr") == 0) {
+            policy = 0;
+        } else if (strcmp(argv[1], "--policy=sjf") == 0) {
+            policy = 1;
+        } else if (strcmp(argv[1], "--backend=signal") == 0) {
+            backend = 0;
+        } else if (strcmp(argv[1], "--backend=cgroup") == 0) {
+            backend = 1;
+        } else if (strcmp(argv[1], "--adaptive") == 0) {
+            adaptive = 1;
+        } else {
+            fprintf(stderr, "Unknown option '%s'.\n", argv[1]);
+            return 1;
+        }
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: %s [--policy=rr|sjf] [--backend=signal|cgroup] [--adaptive] <NCPU> <TSLICE_ms> [trace_file]\n", argv[0]);
         return 1;
     }
 
@@ -201,8 +317,9 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    printf("Starting simpleShell with NCPU=%d, TSLICE=%dms\n", ncpu, tslice);
-    init_scheduler(ncpu, tslice);
+    printf("Starting simpleShell with NCPU=%d, TSLICE=%dms%s, policy=%s\n", ncpu, tslice,
+           adaptive ? " (target latency)" : "", policy ? "sjf" : "rr");
+    init_scheduler(ncpu, tslice, policy, backend, adaptive, argc == 4 ? argv[3] : NULL);
     shell_loop();
     cleanup();
 
@@ -5,8 +5,16 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <dirent.h>
 
-#define MAX_JOBS 100
+#define MAX_JOBS 100000
+#define NPRIO 64 // priority levels, 0 is the highest; one bit per level in a runqueue bitmap
+#define DEFAULT_PRIO 1
 
 typedef struct { // shm structure matches shell.c
     int ncpu;
@@ -18,9 +26,25 @@ typedef struct { // shm structure matches shell.c
     int complete_time[MAX_JOBS];
     int wait_time[MAX_JOBS];
     int job_finished[MAX_JOBS];
+    int job_priority[MAX_JOBS];
+    int job_arrival_ms[MAX_JOBS];
+    int job_finish_ms[MAX_JOBS];
     int shutdown;
+    int policy;
+    int backend;
+    int adaptive;
 } scheduler_data;
 
+typedef enum { // scheduling policy, set by the shell for live runs and on the command line for --simulate
+    POLICY_RR,
+    POLICY_SJF   // shortest predicted remaining time first, preemptive at slice boundaries
+} sched_policy;
+
+typedef enum { // how the scheduler enforces NCPU and the policy on live jobs
+    BACKEND_SIGNAL, // SIGSTOP/SIGCONT at every slice boundary
+    BACKEND_CGROUP  // one cgroup v2 group per job under a group limited to NCPU, kernel does the sharing
+} sched_backend;
+
 typedef enum { // internal state for each job tracked by the scheduler
     READY,
     RUNNING,
@@ -30,17 +54,337 @@ typedef enum { // internal state for each job tracked by the scheduler
 typedef struct { // state structure
     job_status status;
     int time_slices_used;
-    int total_wait_time;
+    long cpu_ms;        // length of the slices the job ran in
+    long wait_ms;       // time spent in the ready queue
+    long ready_since;   // clock_ms at which the job last entered the ready queue
+    double predicted;   // predicted cpu time in ms when the job arrived
+    int width;          // cpu slots the job takes, the threads in its process group, at most NCPU
+    int counted;        // width has been measured at least once
 } job_state;
 
+// priority array of the O(1) scheduler: a fifo list per priority level, linked through the runqueue's
+// next[] by job index, and a bitmap of the non-empty levels, so push and pop never look at more than one level
+typedef struct {
+    unsigned long bitmap;
+    int head[NPRIO];
+    int tail[NPRIO];
+} prio_array;
+
+// ready queue of the O(1) scheduler: jobs are taken from the highest non-empty level of the active array
+// and a job whose slice ran out waits in the expired array. When the active array is empty the two are
+// swapped and a new round starts, so priority orders the jobs within a round and every ready job runs in
+// every round. A round takes newly ready jobs only until it has run as many jobs as it started with,
+// later ones wait in the expired array, so a stream of high priority arrivals cannot starve lower levels
+typedef struct {
+    prio_array arrays[2];
+    prio_array *active, *expired;
+    int *next;
+    int size;
+    int round_left; // jobs the current round runs before it stops taking new ones
+} runqueue;
+
+void rq_init(runqueue *rq, int *next) {
+    rq->arrays[0].bitmap = rq->arrays[1].bitmap = 0;
+    rq->active = &rq->arrays[0];
+    rq->expired = &rq->arrays[1];
+    rq->next = next;
+    rq->size = 0;
+    rq->round_left = 0;
+}
+
+void prio_push(prio_array *a, int *next, int job, int prio) {
+    next[job] = -1;
+    if (a->bitmap & (1UL << prio)) {
+        next[a->tail[prio]] = job;
+    } else {
+        a->head[prio] = job;
+        a->bitmap |= 1UL << prio;
+    }
+    a->tail[prio] = job;
+}
+
+// adds a job that arrived or is ready again after io, to this round if it still takes new jobs
+void rq_push(runqueue *rq, int job, int prio) {
+    prio_push(rq->round_left > 0 ? rq->active : rq->expired, rq->next, job, prio);
+    rq->size++;
+}
+
+// adds a job whose slice ran out, it runs again in the next round
+void rq_expire(runqueue *rq, int job, int prio) {
+    prio_push(rq->expired, rq->next, job, prio);
+    rq->size++;
+}
+
+// removes the first job of the highest priority level of the active array, starting a new round first
+// if the active array is empty; -1 if there is no job
+int rq_pop(runqueue *rq) {
+    if (rq->active->bitmap == 0) {
+        if (rq->expired->bitmap == 0) {
+            return -1;
+        }
+        prio_array *done = rq->active;
+        rq->active = rq->expired;
+        rq->expired = done;
+        rq->round_left = rq->size;
+    }
+    prio_array *a = rq->active;
+    int prio = __builtin_ctzl(a->bitmap);
+    int job = a->head[prio];
+    a->head[prio] = rq->next[job];
+    if (a->head[prio] == -1) {
+        a->bitmap &= ~(1UL << prio);
+    }
+    rq->size--;
+    rq->round_left--;
+    return job;
+}
+
+// puts back the job the last rq_pop returned, in front of its level, as if it had not been taken
+void rq_unpop(runqueue *rq, int job, int prio) {
+    prio_array *a = rq->active;
+    if (a->bitmap & (1UL << prio)) {
+        rq->next[job] = a->head[prio];
+    } else {
+        rq->next[job] = -1;
+        a->tail[prio] = job;
+        a->bitmap |= 1UL << prio;
+    }
+    a->head[prio] = job;
+    rq->size++;
+    rq->round_left++;
+}
+
+int clamp_prio(int prio) {
+    return prio < 0 ? 0 : prio >= NPRIO ? NPRIO - 1 : prio;
+}
+
+typedef struct { // min-heap entry, used for the sjf ready queue and for io completions in the simulator
+    long key;
+    int job;
+} heap_ent;
+
+void heap_push(heap_ent *heap, int *size, long key, int job) {
+    int i = (*size)++;
+    while (i > 0 && heap[(i - 1) / 2].key > key) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i].key = key;
+    heap[i].job = job;
+}
+
+heap_ent heap_pop(heap_ent *heap, int *size) {
+    heap_ent top = heap[0];
+    heap_ent last = heap[--(*size)];
+    int i = 0;
+    while (2 * i + 1 < *size) {
+        int child = 2 * i + 1;
+        if (child + 1 < *size && heap[child + 1].key < heap[child].key) {
+            child++;
+        }
+        if (heap[child].key >= last.key) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+// ---------------- burst prediction ----------------
+// exponentially averaged cpu time per executable name, estimate = a * last + (1 - a) * estimate.
+// live runs load the table from PREDICTION_FILE and write it back on exit, the simulator learns from scratch.
+
+#define PREDICTION_FILE "predictions.table"
+#define PREDICT_ALPHA 0.5
+
+typedef struct {
+    char *name;         // NULL for a free slot
+    double estimate;    // ms
+    int samples;
+} prediction;
+
+prediction *predictions = NULL; // open addressing, the capacity is a power of two
+int predictions_cap = 0;
+int predictions_len = 0;
+double predictions_sum = 0;     // sum of all estimates, its mean is the guess for names never seen
+int predictions_changed = 0;
+
+unsigned long name_hash(const char *name) { // FNV-1a
+    unsigned long h = 14695981039346656037UL;
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)*name) * 1099511628211UL;
+    }
+    return h;
+}
+
+prediction *predict_slot(prediction *table, int cap, const char *name) {
+    unsigned long i = name_hash(name) & (cap - 1);
+    while (table[i].name != NULL && strcmp(table[i].name, name) != 0) {
+        i = (i + 1) & (cap - 1);
+    }
+    return &table[i];
+}
+
+// returns the entry for name, adding an empty one if create is set and there is none
+prediction *predict_lookup(const char *name, int create) {
+    if (!create) {
+        prediction *p = predictions_cap > 0 ? predict_slot(predictions, predictions_cap, name) : NULL;
+        return p != NULL && p->name != NULL ? p : NULL;
+    }
+    if (2 * (predictions_len + 1) > predictions_cap) { // keep the table at most half full
+        int cap = predictions_cap ? 2 * predictions_cap : 64;
+        prediction *table = calloc(cap, sizeof(prediction));
+        if (table == NULL) {
+            perror("calloc failed for prediction table");
+            exit(1);
+        }
+        for (int i = 0; i < predictions_cap; i++) {
+            if (predictions[i].name != NULL) {
+                *predict_slot(table, cap, predictions[i].name) = predictions[i];
+            }
+        }
+        free(predictions);
+        predictions = table;
+        predictions_cap = cap;
+    }
+    prediction *p = predict_slot(predictions, predictions_cap, name);
+    if (p->name == NULL) {
+        p->name = strdup(name);
+        if (p->name == NULL) {
+            perror("strdup failed for prediction table");
+            exit(1);
+        }
+        predictions_len++;
+    }
+    return p;
+}
+
+// predicted cpu time of a run of name in ms
+double predict_burst(const char *name, int tslice) {
+    prediction *p = predict_lookup(name, 0);
+    if (p != NULL && p->samples > 0) {
+        return p->estimate;
+    }
+    return predictions_len > 0 && predictions_sum > 0 ? predictions_sum / predictions_len : tslice;
+}
+
+void predict_update(const char *name, double actual) {
+    prediction *p = predict_lookup(name, 1);
+    double old = p->estimate;
+    p->estimate = p->samples > 0 ? PREDICT_ALPHA * actual + (1 - PREDICT_ALPHA) * old : actual;
+    p->samples++;
+    predictions_sum += p->estimate - old;
+    predictions_changed = 1;
+}
+
+// table lines: "estimate_ms samples name"
+void predict_load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return; // no history yet
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+        double estimate;
+        int samples, name_at;
+        if (line[0] == '#' || sscanf(line, "%lf %d %n", &estimate, &samples, &name_at) != 2 || samples <= 0) {
+            continue;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        prediction *p = predict_lookup(line + name_at, 1);
+        predictions_sum += estimate - p->estimate;
+        p->estimate = estimate;
+        p->samples = samples;
+    }
+    fclose(fp);
+}
+
+void predict_save(const char *path) {
+    if (!predictions_changed) {
+        return;
+    }
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        perror("fopen failed for prediction table");
+        return;
+    }
+    fprintf(fp, "# estimate_ms samples name\n");
+    for (int i = 0; i < predictions_cap; i++) {
+        if (predictions[i].name != NULL && predictions[i].samples > 0) {
+            fprintf(fp, "%.1f %d %s\n", predictions[i].estimate, predictions[i].samples, predictions[i].name);
+        }
+    }
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) { // readers never see a half written table
+        perror("writing prediction table failed");
+        unlink(tmp);
+    }
+}
+
+void predict_free() {
+    for (int i = 0; i < predictions_cap; i++) {
+        free(predictions[i].name);
+    }
+    free(predictions);
+    predictions = NULL;
+    predictions_cap = predictions_len = 0;
+    predictions_sum = 0;
+}
+
+// predicted remaining cpu time of a job that was predicted to need predicted ms and has used served ms.
+// a job that outlives its prediction is guessed to need as much again as it has overrun so far: a slight
+// overrun is probably almost done, a large one drops back behind short jobs instead of holding a cpu.
+long predict_remaining(double predicted, long served) {
+    return predicted > served ? (long)(predicted - served) : served - (long)predicted + 1;
+}
+
 scheduler_data *sched_data = NULL;
 job_state job_states[MAX_JOBS];
-int ready_queue[MAX_JOBS];
-int queue_head = 0;
-int queue_tail = 0;
+runqueue ready_queue;          // rr ready queue
+int ready_next[MAX_JOBS];
+heap_ent ready_heap[MAX_JOBS]; // sjf ready queue, keyed by predicted remaining time
+int heap_size = 0;
 int jobs_in = 0;
+int slice_clock = 0;           // number of slices elapsed since start
+long clock_ms = 0;             // scheduler time since start, the sum of all slice lengths
+
+// per-run statistics, reported when the scheduler shuts down
+int jobs_done = 0;
+long turnaround_ms = 0;
+long wait_total_ms = 0;
+double prediction_error = 0; // sum of |predicted - actual| in ms
+double actual_total = 0;
+long signals_sent = 0;       // SIGSTOP and SIGCONT sent to jobs
+double share_sum = 0;        // sums of each job's cpu time / turnaround, for Jain's fairness index
+double share_sum2 = 0;
+int widest_job = 0;          // most cpu slots taken by one job
+long gang_skips = 0;         // jobs passed over in a slice because they were wider than the free slots
+
+// slice lengths, every decision is also logged to SLICE_LOG in --adaptive mode
+#define SLICE_LOG "slices.log"
+FILE *slice_log = NULL;        // "clock_ms runnable overhead_us slice_ms" per slice
+double switch_overhead_ms = 0; // moving average of the cost of a slice boundary
+long slice_sum = 0;
+int slice_min = 0, slice_max = 0, slice_changes = 0, last_slice = 0;
+
+FILE *record_file = NULL; // trace of finished jobs, written in --record mode
+long arrival_ms[MAX_JOBS]; // clock_ms at which each job was first seen
+
+void cgroup_stop();
 
 void cleanup_and_exit(int sig) {
+    (void)sig;
+    predict_save(PREDICTION_FILE);
+    cgroup_stop();
+    if (slice_log != NULL) {
+        fclose(slice_log);
+    }
+    if (record_file != NULL) {
+        fclose(record_file);
+    }
     if (sched_data != NULL) {
         shmdt(sched_data);
     }
@@ -64,96 +408,1080 @@ void init_shared_memory() {
     for (int i = 0; i < MAX_JOBS; i++) {
         job_states[i].status = FINISHED; // initially no jobs
     }
+    rq_init(&ready_queue, ready_next);
 }
 
 void enqueue(int job_idx) { //add job idex behind the ready queue
-    ready_queue[queue_tail] = job_idx;
-    queue_tail = (queue_tail + 1) % MAX_JOBS;
+    job_states[job_idx].ready_since = clock_ms;
+    if (sched_data->policy == POLICY_SJF) { // ties go to the job that arrived first
+        long key = predict_remaining(job_states[job_idx].predicted, job_states[job_idx].cpu_ms) * MAX_JOBS + job_idx;
+        heap_push(ready_heap, &heap_size, key, job_idx);
+        return;
+    }
+    rq_push(&ready_queue, job_idx, sched_data->job_priority[job_idx]);
+}
+
+// adds a job whose slice ran out behind the ready queue, for rr it waits for the next round
+void requeue(int job_idx) {
+    if (sched_data->policy == POLICY_SJF) {
+        enqueue(job_idx);
+        return;
+    }
+    job_states[job_idx].ready_since = clock_ms;
+    rq_expire(&ready_queue, job_idx, sched_data->job_priority[job_idx]);
 }
 
-// removes a job index from front of the ready queue
+// puts a job dequeue() just returned back at the front of the ready queue, without charging it any wait
+void put_back(int job_idx) {
+    job_states[job_idx].wait_ms -= clock_ms - job_states[job_idx].ready_since;
+    if (sched_data->policy == POLICY_SJF) {
+        long key = predict_remaining(job_states[job_idx].predicted, job_states[job_idx].cpu_ms) * MAX_JOBS + job_idx;
+        heap_push(ready_heap, &heap_size, key, job_idx);
+        return;
+    }
+    rq_unpop(&ready_queue, job_idx, sched_data->job_priority[job_idx]);
+}
+
+// removes the next job to run from the ready queue and charges it the time it waited there
 int dequeue() {
-    if (queue_head == queue_tail){
-        return -1;
-    }               // empty
-    int job_idx = ready_queue[queue_head];
-    queue_head = (queue_head + 1) % MAX_JOBS;
+    int job_idx;
+    if (sched_data->policy == POLICY_SJF) {
+        job_idx = heap_size > 0 ? heap_pop(ready_heap, &heap_size).job : -1;
+    } else {
+        job_idx = rq_pop(&ready_queue);
+    }
+    if (job_idx != -1) {
+        job_states[job_idx].wait_ms += clock_ms - job_states[job_idx].ready_since;
+    }
     return job_idx;
 }
 
 int is_empty() {
-    return queue_head == queue_tail;
+    if (sched_data->policy == POLICY_SJF) {
+        return heap_size == 0;
+    }
+    return ready_queue.size == 0;
 }
 
-void round_robin_schedule() {
-    int list_runningjob[sched_data->ncpu];
-    for (int i = 0; i < sched_data->ncpu; i++){
-        list_runningjob[i] = -1;
+// appends one finished job to the trace in the format read by --simulate
+void record_job(int job_idx) {
+    if (record_file == NULL) {
+        return;
+    }
+    fprintf(record_file, "%ld %ld %d %s\n",
+            arrival_ms[job_idx],
+            job_states[job_idx].cpu_ms,
+            sched_data->job_priority[job_idx],
+            sched_data->job_names[job_idx]);
+    fflush(record_file);
+}
+
+// a job finished in the current slice: learn its cpu time, add it to the run statistics and
+// report its cpu and wait time to the shell in units of TSLICE
+void finish_job(int job_idx) {
+    int tslice = sched_data->tslice;
+    job_states[job_idx].status = FINISHED;
+    sched_data->job_finished[job_idx] = 1;
+    sched_data->complete_time[job_idx] = (job_states[job_idx].cpu_ms + tslice / 2) / tslice;
+    sched_data->wait_time[job_idx] = (job_states[job_idx].wait_ms + tslice / 2) / tslice;
+    sched_data->job_arrival_ms[job_idx] = arrival_ms[job_idx];
+    sched_data->job_finish_ms[job_idx] = clock_ms;
+    record_job(job_idx);
+    double actual = job_states[job_idx].cpu_ms;
+    double error = job_states[job_idx].predicted - actual;
+    prediction_error += error < 0 ? -error : error;
+    actual_total += actual;
+    predict_update(sched_data->job_names[job_idx], actual);
+    turnaround_ms += clock_ms - arrival_ms[job_idx];
+    wait_total_ms += job_states[job_idx].wait_ms;
+    double lifetime = clock_ms - arrival_ms[job_idx];
+    double share = lifetime > 0 && actual < lifetime ? actual / lifetime : 1.0;
+    share_sum += share;
+    share_sum2 += share * share;
+    jobs_done++;
+}
+
+void print_report() {
+    if (jobs_done == 0) {
+        return;
+    }
+    printf("\n--- Scheduler Report ---\n");
+    printf("Policy: %s, jobs: %d\n", sched_data->policy == POLICY_SJF ? "sjf" : "rr", jobs_done);
+    printf("Turnaround: mean %.1f ms, wait: mean %.1f ms\n",
+           (double)turnaround_ms / jobs_done, (double)wait_total_ms / jobs_done);
+    printf("Prediction error: mean %.1f ms (%.1f%% of mean cpu time)\n", prediction_error / jobs_done,
+           actual_total > 0 ? 100.0 * prediction_error / actual_total : 0.0);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Backend: %s, %ld signals, scheduler cpu time %.1f ms over %d slices\n",
+           sched_data->backend == BACKEND_CGROUP ? "cgroup" : "signal", signals_sent,
+           usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 +
+           usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0, slice_clock);
+    printf("Jain fairness index: %.4f\n", share_sum2 > 0 ? share_sum * share_sum / (jobs_done * share_sum2) : 1.0);
+    if (slice_clock > 0 && sched_data->backend == BACKEND_SIGNAL) {
+        printf("Slices: %s, length min %d ms, mean %.1f ms, max %d ms, changed %d times, switch cost %.2f ms\n",
+               sched_data->adaptive ? "adaptive (every decision in " SLICE_LOG ")" : "fixed", slice_min,
+               (double)slice_sum / slice_clock, slice_max, slice_changes, switch_overhead_ms);
+        printf("Gang: widest job %d of %d slots, %ld times a job was too wide for the free slots\n",
+               widest_job, sched_data->ncpu, gang_skips);
+    }
+    printf("------------------------\n");
+    fflush(stdout);
+}
+
+// ---------------- adaptive time slice ----------------
+// with --adaptive TSLICE is a target latency, the time in which every runnable job should get a turn,
+// like sched_latency in CFS. Each slice is the target divided by the jobs waiting per cpu, no shorter than
+// ADAPT_MIN_MS and no shorter than ADAPT_OVERHEAD times the measured cost of a slice boundary, so that
+// switching stays under 1 / ADAPT_OVERHEAD of the time, and never longer than the target.
+
+#define ADAPT_MIN_MS 2
+#define ADAPT_OVERHEAD 20
+
+int pick_slice() {
+    int slice = sched_data->tslice;
+    if (sched_data->adaptive) {
+        int per_cpu = (jobs_in + sched_data->ncpu - 1) / sched_data->ncpu;
+        int floor = ADAPT_MIN_MS;
+        if (switch_overhead_ms * ADAPT_OVERHEAD > floor) {
+            floor = (int)(switch_overhead_ms * ADAPT_OVERHEAD) + 1;
+        }
+        slice = per_cpu > 1 ? sched_data->tslice / per_cpu : sched_data->tslice;
+        if (slice < floor) {
+            slice = floor < sched_data->tslice ? floor : sched_data->tslice;
+        }
+        if (slice_log != NULL) {
+            fprintf(slice_log, "%ld %d %.0f %d\n", clock_ms, jobs_in, switch_overhead_ms * 1000, slice);
+        }
+    }
+    slice_sum += slice;
+    slice_min = slice_min == 0 || slice < slice_min ? slice : slice_min;
+    slice_max = slice > slice_max ? slice : slice_max;
+    slice_changes += last_slice != 0 && slice != last_slice;
+    last_slice = slice;
+    return slice;
+}
+
+double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// ---------------- gang scheduling ----------------
+// every job leads its own process group (the shell calls setpgid), so the workers it forks and its
+// threads are continued and stopped together with kill(-pgid). A job takes one slot of NCPU per live
+// thread in its group, measured at the end of every slice it ran in, and all of its members run in the
+// same slice, so a parallel job never spins at a barrier waiting for a peer that is stopped.
+// Counting means reading every /proc/<pid>/stat, about 10 times the rest of a slice boundary, so it is
+// done in the first slice a job runs and then at most every WIDTH_SCAN_MS.
+
+#define WIDTH_SCAN_MS 100
+
+long widths_at = -WIDTH_SCAN_MS; // clock_ms of the last count
+
+// sets the width of each running job from the threads of the live processes in its group
+void measure_widths(int *running, int nrunning) {
+    int due = clock_ms - widths_at >= WIDTH_SCAN_MS;
+    for (int k = 0; k < nrunning && !due; k++) {
+        due = !job_states[running[k]].counted;
+    }
+    if (!due) {
+        return;
+    }
+    widths_at = clock_ms;
+    int threads[nrunning];
+    for (int k = 0; k < nrunning; k++) {
+        threads[k] = 0;
+    }
+    DIR *dir = opendir("/proc");
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] < '1' || ent->d_name[0] > '9') {
+            continue;
+        }
+        char path[300], buf[512], state;
+        int pgrp, nthreads;
+        snprintf(path, sizeof(path), "/proc/%s/stat", ent->d_name);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+            continue; // exited since readdir
+        }
+        char *fields = NULL;
+        if (fgets(buf, sizeof(buf), fp) != NULL && (fields = strrchr(buf, ')')) != NULL) {
+            fields += 2;
+        }
+        fclose(fp);
+        // after the command name: state ppid pgrp, then num_threads is the 15th field after pgrp
+        if (fields == NULL || sscanf(fields, "%c %*s %d %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %d",
+                                     &state, &pgrp, &nthreads) != 3 || state == 'Z') {
+            continue;
+        }
+        for (int k = 0; k < nrunning; k++) {
+            if (sched_data->job_pids[running[k]] == pgrp) {
+                threads[k] += nthreads;
+            }
+        }
+    }
+    closedir(dir);
+    for (int k = 0; k < nrunning; k++) {
+        job_states[running[k]].counted = 1;
+        if (threads[k] > 0) {
+            int width = threads[k] < sched_data->ncpu ? threads[k] : sched_data->ncpu;
+            job_states[running[k]].width = width;
+            widest_job = width > widest_job ? width : widest_job;
+        }
     }
+}
+
+void schedule() {
+    int running[sched_data->ncpu]; // jobs in the current slice, each takes at least one slot
+    int nrunning = 0;
+    int held[sched_data->ncpu];    // jobs too wide for the slots left in this slice
     int old_jobc = 0; //last known job count
-    while (!sched_data->shutdown || jobs_in > 0) { //looping till shutdown or finish
+    double woke = 0;  // when the previous slice ended
+    // looping till shutdown or finish, jobs submitted right before shutdown still run
+    while (!sched_data->shutdown || jobs_in > 0 || sched_data->jobc > old_jobc) {
         // check for new submitted jobs from the shell
         if (sched_data->jobc > old_jobc) {
             for (int i = old_jobc; i < sched_data->jobc; i++) {
+                arrival_ms[i] = clock_ms;
                 job_states[i].status = READY;
                 job_states[i].time_slices_used = 0;
-                job_states[i].total_wait_time = 0;
+                job_states[i].cpu_ms = 0;
+                job_states[i].wait_ms = 0;
+                job_states[i].predicted = predict_burst(sched_data->job_names[i], sched_data->tslice);
+                job_states[i].width = 1; // until it has run and its threads can be counted
+                job_states[i].counted = 0;
+                sched_data->job_priority[i] = clamp_prio(sched_data->job_priority[i]);
                 enqueue(i);
                 jobs_in++;
             }
             old_jobc = sched_data->jobc;
         }
                                                                 
-        for (int cpu = 0; cpu < sched_data->ncpu; cpu++) {// schedule jobs from the ready queue onto cpus
-            if (list_runningjob[cpu] == -1 && !is_empty()) {
-                int job_idx = dequeue();
-                if (job_idx != -1) {
-                    list_runningjob[cpu] = job_idx;
-                    job_states[job_idx].status = RUNNING;
-                    kill(sched_data->job_pids[job_idx], SIGCONT);
-                }
-            }
-        }
-
-        usleep(sched_data->tslice * 1000); // wait for one time slice
-
-        for (int cpu = 0; cpu < sched_data->ncpu; cpu++) { // force exit running jobs and check for completion
-            int job_idx = list_runningjob[cpu];
-            if (job_idx != -1) {
-                // use kill(pid, 0) to check if the process exists, returns -1 if not
-                if (kill(sched_data->job_pids[job_idx], 0) == -1) {
-                    // job has finished
-                    job_states[job_idx].status = FINISHED;
-                    sched_data->job_finished[job_idx] = 1;
-                    job_states[job_idx].time_slices_used+=1; // count the last slice
-                    sched_data->complete_time[job_idx] = job_states[job_idx].time_slices_used;
-                    sched_data->wait_time[job_idx] = job_states[job_idx].total_wait_time;
-                    jobs_in--;
-                } else {
-                    // force exit it with SIGSTOP
-                    kill(sched_data->job_pids[job_idx], SIGSTOP);
-                    job_states[job_idx].time_slices_used++;
-                    job_states[job_idx].status = READY;
-                    enqueue(job_idx); // add it back to the ready queue
-                }
-                list_runningjob[cpu] = -1; // free cpu
-            }
-        }    
-        if (!is_empty()) {
-            int current = queue_head;
-            while (current != queue_tail) {
-                job_states[ready_queue[current]].total_wait_time++;  // update wait time for all jobs in ready
-                current = (current + 1) % MAX_JOBS;
-            }
-        }
-    }
-}
-
-int main() {
+        // fill the slots from the ready queue, whole groups at a time. A job wider than the slots left is
+        // held back and narrower jobs behind it may run; every slot is free again at the next slice,
+        // so the job at the head of the queue always fits then and wide jobs are never starved
+        int free_slots = sched_data->ncpu, nheld = 0;
+        while (free_slots > 0 && nheld < sched_data->ncpu && !is_empty()) {
+            int job_idx = dequeue();
+            if (job_states[job_idx].width > free_slots) {
+                held[nheld++] = job_idx;
+                gang_skips++;
+                continue;
+            }
+            running[nrunning++] = job_idx;
+            free_slots -= job_states[job_idx].width;
+            job_states[job_idx].status = RUNNING;
+            kill(-sched_data->job_pids[job_idx], SIGCONT);
+            signals_sent++;
+        }
+        for (int k = nheld - 1; k >= 0; k--) { // back in front, in the order they were taken
+            put_back(held[k]);
+        }
+
+        int slice = pick_slice();
+        double slept = now_ms();
+        usleep(slice * 1000); // wait for one time slice
+        // a slice boundary costs the work since the previous one ended plus any oversleeping
+        double now = now_ms();
+        if (woke > 0) {
+            double overhead = (slept - woke) + (now - slept - slice);
+            switch_overhead_ms += ((overhead > 0 ? overhead : 0) - switch_overhead_ms) / 8;
+        }
+        woke = now;
+        slice_clock++;
+        clock_ms += slice;
+
+        measure_widths(running, nrunning);
+        for (int k = 0; k < nrunning; k++) { // force exit running jobs and check for completion
+            int job_idx = running[k];
+            // use kill(-pgid, 0) to check if any process of the job is left, returns -1 if not
+            if (kill(-sched_data->job_pids[job_idx], 0) == -1) {
+                // job has finished
+                job_states[job_idx].time_slices_used+=1; // count the last slice
+                job_states[job_idx].cpu_ms += slice;
+                finish_job(job_idx);
+                jobs_in--;
+            } else {
+                // force exit the whole group with SIGSTOP
+                kill(-sched_data->job_pids[job_idx], SIGSTOP);
+                signals_sent++;
+                job_states[job_idx].time_slices_used++;
+                job_states[job_idx].cpu_ms += slice;
+                job_states[job_idx].status = READY;
+                requeue(job_idx); // add it back to the ready queue
+            }
+        }
+        nrunning = 0; // every slot is free for the next slice
+        // wait time is charged when a job leaves the ready queue, so nothing here walks the queue
+    }
+}
+
+// ---------------- cgroup v2 backend ----------------
+// every job gets its own group under one scheduler group, which is created in the cgroup the scheduler
+// was started in, so a delegated cgroup (systemd Delegate=yes) is enough and no root is needed. The
+// scheduler group's cpu.max allows NCPU cpus worth of time per period (and cpuset.cpus pins it to NCPU
+// of the cpus its parent may use when the cpuset controller is there), and each job's cpu.weight carries
+// the policy, so the kernel shares the cpus continuously and the scheduler only starts jobs, watches for
+// them to finish and reads their cpu.stat.
+
+#define CGROUP_PERIOD_US 100000
+
+char cgroup_dir[PATH_MAX] = "";    // the scheduler group, empty while no group exists
+char cgroup_parent[PATH_MAX] = ""; // the cgroup the scheduler was started in, holding the scheduler group
+char cgroup_leaf[PATH_MAX] = "";   // group the shell and the scheduler were moved to, empty if they were not
+int cgroup_enabled_cpu = 0, cgroup_enabled_cpuset = 0; // controllers this scheduler enabled in the parent
+
+int cgroup_write(const char *dir, const char *file, const char *value) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+    int ok = fputs(value, fp) >= 0;
+    return fclose(fp) == 0 && ok ? 0 : -1;
+}
+
+// first line of dir/file without its newline, empty for an empty file; -1 if it cannot be read
+int cgroup_read(const char *dir, const char *file, char *buf, int len) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fgets(buf, len, fp) == NULL) {
+        buf[0] = '\0';
+    }
+    fclose(fp);
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+// true if a space separated controller list like cgroup.controllers names the controller
+int cgroup_has(const char *list, const char *name) {
+    size_t n = strlen(name);
+    for (const char *p = list; (p = strstr(p, name)) != NULL; p += n) {
+        if ((p == list || p[-1] == ' ') && (p[n] == '\0' || p[n] == ' ')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// moves the shell and the scheduler out of the parent into a leaf group of their own
+int cgroup_move_out() {
+    char pid[32];
+    if (snprintf(cgroup_leaf, sizeof(cgroup_leaf), "%s/simplescheduler-%d-shell", cgroup_parent, getpid()) >=
+            (int)sizeof(cgroup_leaf) || mkdir(cgroup_leaf, 0755) < 0) {
+        cgroup_leaf[0] = '\0';
+        return -1;
+    }
+    snprintf(pid, sizeof(pid), "%d", getppid());
+    if (cgroup_write(cgroup_leaf, "cgroup.procs", pid) < 0) {
+        return -1;
+    }
+    snprintf(pid, sizeof(pid), "%d", getpid());
+    return cgroup_write(cgroup_leaf, "cgroup.procs", pid);
+}
+
+// enables a controller for the children of the parent. cgroup v2 only allows that in a group without
+// processes of its own (the root excepted), so if the shell and the scheduler are still in the parent
+// they are moved out first, which cgroup_stop() undoes
+int cgroup_enable(const char *name, int *enabled) {
+    char active[256], value[64];
+    if (cgroup_read(cgroup_parent, "cgroup.subtree_control", active, sizeof(active)) < 0) {
+        return -1;
+    }
+    if (cgroup_has(active, name)) {
+        return 0;
+    }
+    snprintf(value, sizeof(value), "+%s", name);
+    if (cgroup_write(cgroup_parent, "cgroup.subtree_control", value) < 0 &&
+        (errno != EBUSY || cgroup_leaf[0] != '\0' || cgroup_move_out() < 0 ||
+         cgroup_write(cgroup_parent, "cgroup.subtree_control", value) < 0)) {
+        return -1;
+    }
+    *enabled = 1;
+    return 0;
+}
+
+// writes the first n cpus of a cpu list like "0-3,8-11" to value as a list of ranges; returns 0 if the
+// list has no more than n cpus, so there is nothing to pin
+int cgroup_first_cpus(const char *list, int n, char *value, size_t len) {
+    int taken = 0, total = 0;
+    size_t used = 0;
+    value[0] = '\0';
+    for (const char *p = list; *p >= '0' && *p <= '9';) {
+        char *end;
+        long low = strtol(p, &end, 10), high = low;
+        if (*end == '-') {
+            high = strtol(end + 1, &end, 10);
+        }
+        total += high - low + 1;
+        if (taken < n && used < len) {
+            long last = high < low + (n - taken) - 1 ? high : low + (n - taken) - 1;
+            used += snprintf(value + used, len - used, "%s%ld-%ld", used ? "," : "", low, last);
+            taken += last - low + 1;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return total > n;
+}
+
+void cgroup_job_dir(int job_idx, char *path, size_t len) {
+    snprintf(path, len, "%s/job-%d", cgroup_dir, job_idx);
+}
+
+// cpu time of a job in microseconds, from usage_usec in its cpu.stat, -1 if it cannot be read
+long cgroup_usage_usec(int job_idx) {
+    char path[PATH_MAX], line[256];
+    cgroup_job_dir(job_idx, path, sizeof(path));
+    strncat(path, "/cpu.stat", sizeof(path) - strlen(path) - 1);
+    FILE *fp = fopen(path, "r");
+    long usec = -1;
+    if (fp == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "usage_usec %ld", &usec) == 1) {
+            break;
+        }
+    }
+    fclose(fp);
+    return usec;
+}
+
+// relative cpu share of a job: priorities step by 1.25x per level like nice values, sjf
+// gives jobs predicted to be short a larger share (100 for one second of predicted cpu time)
+int cgroup_weight(int job_idx) {
+    double weight = 100;
+    for (int p = sched_data->job_priority[job_idx]; p < DEFAULT_PRIO; p++) weight *= 1.25;
+    for (int p = sched_data->job_priority[job_idx]; p > DEFAULT_PRIO; p--) weight /= 1.25;
+    if (sched_data->policy == POLICY_SJF) {
+        weight *= 1000.0 / (job_states[job_idx].predicted > 1 ? job_states[job_idx].predicted : 1);
+    }
+    return weight < 1 ? 1 : weight > 10000 ? 10000 : (int)weight;
+}
+
+// finds the cgroup2 mount and the scheduler's own cgroup and sets up the scheduler group in it. Returns
+// 0, with the reason on stderr, if there is no cgroup v2 cpu controller the scheduler may use, and the
+// signal backend runs instead
+int cgroup_start() {
+    FILE *fp = fopen("/proc/self/mounts", "r");
+    char line[1024], dev[256], mnt[1024], type[64], controllers[256] = "", value[256];
+    char *root = NULL, *own = NULL;
+    while (fp != NULL && fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%255s %1023s %63s", dev, mnt, type) == 3 && strcmp(type, "cgroup2") == 0) {
+            root = mnt;
+            break;
+        }
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    if (root == NULL) {
+        fprintf(stderr, "cgroup backend: no cgroup2 mount, using signals\n");
+        return 0;
+    }
+    // the "0::<path>" line of /proc/self/cgroup is the scheduler's cgroup v2 group below the mount
+    fp = fopen("/proc/self/cgroup", "r");
+    while (fp != NULL && fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            own = line + 3;
+            break;
+        }
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    if (own == NULL) {
+        fprintf(stderr, "cgroup backend: not in a cgroup v2 group, using signals\n");
+        return 0;
+    }
+    snprintf(cgroup_parent, sizeof(cgroup_parent), "%s%s", root, strcmp(own, "/") == 0 ? "" : own);
+    if (cgroup_read(cgroup_parent, "cgroup.controllers", controllers, sizeof(controllers)) < 0 ||
+        !cgroup_has(controllers, "cpu") || cgroup_enable("cpu", &cgroup_enabled_cpu) < 0) {
+        fprintf(stderr, "cgroup backend: the cpu controller is not available in %s, using signals\n", cgroup_parent);
+        cgroup_stop();
+        return 0;
+    }
+    int cpuset = cgroup_has(controllers, "cpuset") && cgroup_enable("cpuset", &cgroup_enabled_cpuset) == 0;
+
+    snprintf(value, sizeof(value), "%ld %d", (long)sched_data->ncpu * CGROUP_PERIOD_US, CGROUP_PERIOD_US);
+    if (snprintf(cgroup_dir, sizeof(cgroup_dir), "%s/simplescheduler-%d", cgroup_parent, getpid()) >=
+            (int)sizeof(cgroup_dir) || mkdir(cgroup_dir, 0755) < 0 || cgroup_write(cgroup_dir, "cpu.max", value) < 0 ||
+        cgroup_write(cgroup_dir, "cgroup.subtree_control", cpuset ? "+cpu +cpuset" : "+cpu") < 0) {
+        perror("cgroup backend: setting up the scheduler group failed, using signals");
+        cgroup_stop();
+        return 0;
+    }
+    // a new group starts out with the cpus its parent may use as cpuset.cpus.effective
+    if (cpuset && cgroup_read(cgroup_dir, "cpuset.cpus.effective", line, sizeof(line)) == 0 &&
+        cgroup_first_cpus(line, sched_data->ncpu, value, sizeof(value))) {
+        cgroup_write(cgroup_dir, "cpuset.cpus", value);
+    }
+    return 1;
+}
+
+// moves a newly submitted job into its own group; returns 0 if that failed and the job runs in the
+// scheduler group's parent without a limit
+int cgroup_add_job(int job_idx) {
+    char path[PATH_MAX], value[32];
+    cgroup_job_dir(job_idx, path, sizeof(path));
+    snprintf(value, sizeof(value), "%d", cgroup_weight(job_idx));
+    if (mkdir(path, 0755) < 0 || cgroup_write(path, "cpu.weight", value) < 0) {
+        perror("cgroup backend: creating a job group failed");
+        return 0;
+    }
+    snprintf(value, sizeof(value), "%d", sched_data->job_pids[job_idx]);
+    if (cgroup_write(path, "cgroup.procs", value) < 0) {
+        perror("cgroup backend: moving a job into its group failed");
+        return 0;
+    }
+    return 1;
+}
+
+// removes the job groups and the scheduler group and leaves the parent as it was found, jobs that are
+// still running are killed by the caller
+void cgroup_stop() {
+    char path[PATH_MAX + 16], pid[32];
+    if (cgroup_dir[0] != '\0') {
+        for (int i = 0; i < sched_data->jobc && i < MAX_JOBS; i++) {
+            cgroup_job_dir(i, path, sizeof(path));
+            rmdir(path);
+        }
+        rmdir(cgroup_dir);
+        cgroup_dir[0] = '\0';
+    }
+    if (cgroup_enabled_cpuset) {
+        cgroup_write(cgroup_parent, "cgroup.subtree_control", "-cpuset");
+    }
+    if (cgroup_enabled_cpu) {
+        cgroup_write(cgroup_parent, "cgroup.subtree_control", "-cpu");
+    }
+    cgroup_enabled_cpu = cgroup_enabled_cpuset = 0;
+    if (cgroup_leaf[0] != '\0') {
+        // the parent has no controllers for its children again, so the shell and the scheduler may go back
+        snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup_leaf);
+        FILE *fp = fopen(path, "r");
+        while (fp != NULL && fgets(pid, sizeof(pid), fp)) {
+            pid[strcspn(pid, "\n")] = '\0';
+            cgroup_write(cgroup_parent, "cgroup.procs", pid);
+        }
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        rmdir(cgroup_leaf);
+        cgroup_leaf[0] = '\0';
+    }
+}
+
+// true once a job has stopped itself in dummy_main and is waiting for its first SIGCONT
+int job_stopped(pid_t pid) {
+    char path[64], buf[512];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    char *state = NULL;
+    if (fgets(buf, sizeof(buf), fp) != NULL && (state = strrchr(buf, ')')) != NULL) {
+        state += 2;
+    }
+    fclose(fp);
+    return state != NULL && *state == 'T';
+}
+
+// the cgroup loop: once per slice, start new jobs with one SIGCONT each and collect finished ones.
+// cpu time comes from cpu.stat, the rest of a job's lifetime is its wait.
+void cgroup_schedule() {
+    int old_jobc = 0;
+    while (!sched_data->shutdown || jobs_in > 0 || sched_data->jobc > old_jobc) {
+        if (sched_data->jobc > old_jobc) {
+            for (int i = old_jobc; i < sched_data->jobc; i++) {
+                arrival_ms[i] = clock_ms;
+                job_states[i].status = READY;
+                job_states[i].time_slices_used = 0;
+                job_states[i].cpu_ms = 0;
+                job_states[i].wait_ms = 0;
+                job_states[i].predicted = predict_burst(sched_data->job_names[i], sched_data->tslice);
+                sched_data->job_priority[i] = clamp_prio(sched_data->job_priority[i]);
+                cgroup_add_job(i);
+                jobs_in++;
+            }
+            old_jobc = sched_data->jobc;
+        }
+
+        usleep(sched_data->tslice * 1000);
+        slice_clock++;
+        clock_ms += sched_data->tslice;
+
+        for (int i = 0; i < old_jobc; i++) {
+            if (job_states[i].status == FINISHED) {
+                continue;
+            }
+            pid_t pid = sched_data->job_pids[i];
+            if (kill(-pid, 0) == -1) { // no process of the job's group is left
+                long usec = cgroup_usage_usec(i);
+                long lifetime = clock_ms - arrival_ms[i];
+                job_states[i].cpu_ms = usec > 0 ? (usec + 999) / 1000 : 1;
+                job_states[i].wait_ms = lifetime > job_states[i].cpu_ms ? lifetime - job_states[i].cpu_ms : 0;
+                finish_job(i);
+                char path[PATH_MAX];
+                cgroup_job_dir(i, path, sizeof(path));
+                rmdir(path);
+                jobs_in--;
+            } else if (job_states[i].status == READY && job_stopped(pid)) {
+                kill(-pid, SIGCONT); // from here on the kernel shares the cpus
+                signals_sent++;
+                job_states[i].status = RUNNING;
+            }
+        }
+    }
+}
+
+// ---------------- simulation mode ----------------
+// replays a job trace in virtual time using the same slice-by-slice model as schedule(),
+// without forking anything. trace lines: "arrival_ms burst_profile priority [name]" where
+// burst_profile is "cpu_ms" or alternating phases "cpu_ms,io_ms,cpu_ms,..."
+
+typedef struct {
+    long arrival;       // arrival time in ms
+    int burst_off;      // first phase in sim_bursts
+    int nbursts;        // number of cpu/io phases
+    int phase;          // current phase, even phases are cpu and odd ones are io
+    long remaining;     // ms left in the current cpu phase
+    int priority;
+    int name_off;       // offset of the name in sim_names
+    long cpu_total;     // sum of all cpu phases
+    long ready_since;   // time the job last entered the ready queue
+    long wait;          // total time spent in the ready queue
+    long completion;
+    long served;        // cpu time received so far
+    double predicted;   // predicted cpu time when the job arrived
+} sim_job;
+
+sim_job *sim_jobs = NULL;
+int sim_njobs = 0;
+int *sim_bursts = NULL;
+int sim_nbursts = 0;
+char *sim_names = NULL;
+int sim_names_len = 0;
+
+void *sim_grow(void *ptr, int *cap, int need, size_t elem) {
+    if (need <= *cap) {
+        return ptr;
+    }
+    int new_cap = *cap ? *cap : 1024;
+    while (new_cap < need) {
+        new_cap *= 2;
+    }
+    ptr = realloc(ptr, new_cap * elem);
+    if (ptr == NULL) {
+        perror("realloc failed in simulator");
+        exit(1);
+    }
+    *cap = new_cap;
+    return ptr;
+}
+
+int sim_cmp_arrival(const void *a, const void *b) {
+    const sim_job *x = a, *y = b;
+    return (x->arrival > y->arrival) - (x->arrival < y->arrival);
+}
+
+int sim_cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+void sim_load_trace(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror("fopen failed for trace");
+        exit(1);
+    }
+    int jobs_cap = 0, bursts_cap = 0, names_cap = 0;
+    char line[1024];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+        sim_jobs = sim_grow(sim_jobs, &jobs_cap, sim_njobs + 1, sizeof(sim_job));
+        sim_job *job = &sim_jobs[sim_njobs];
+        memset(job, 0, sizeof(*job));
+
+        char *end;
+        job->arrival = strtol(p, &end, 10);
+        if (end == p) {
+            fprintf(stderr, "%s:%d: bad arrival time\n", path, lineno);
+            exit(1);
+        }
+        p = end;
+        job->burst_off = sim_nbursts;
+        do { // comma separated cpu/io phases
+            if (*p == ',') p++;
+            long ms = strtol(p, &end, 10);
+            if (end == p || ms < 0) {
+                fprintf(stderr, "%s:%d: bad burst profile\n", path, lineno);
+                exit(1);
+            }
+            p = end;
+            sim_bursts = sim_grow(sim_bursts, &bursts_cap, sim_nbursts + 1, sizeof(int));
+            sim_bursts[sim_nbursts++] = (int)ms;
+            if (job->nbursts % 2 == 0) {
+                job->cpu_total += ms;
+            }
+            job->nbursts++;
+        } while (*p == ',');
+        if (job->nbursts % 2 == 0) {
+            fprintf(stderr, "%s:%d: burst profile must end with a cpu phase\n", path, lineno);
+            exit(1);
+        }
+        job->priority = clamp_prio((int)strtol(p, &end, 10));
+        p = end;
+        while (*p == ' ' || *p == '\t') p++;
+        p[strcspn(p, " \t\n")] = '\0';
+        int len = strlen(p);
+        sim_names = sim_grow(sim_names, &names_cap, sim_names_len + len + 1, 1);
+        job->name_off = sim_names_len;
+        memcpy(sim_names + sim_names_len, p, len + 1);
+        sim_names_len += len + 1;
+        sim_njobs++;
+    }
+    fclose(fp);
+    qsort(sim_jobs, sim_njobs, sizeof(sim_job), sim_cmp_arrival); // live traces are written in completion order
+}
+
+// ready queue of the simulator: the priority runqueue for rr, a heap keyed by predicted remaining time for sjf
+sched_policy sim_policy = POLICY_RR;
+runqueue sim_queue;
+heap_ent *sim_ready_heap = NULL;
+int sim_ready_size = 0;
+
+void sim_ready_push(int j, long now) {
+    sim_jobs[j].ready_since = now;
+    if (sim_policy == POLICY_SJF) { // ties go to the job that arrived first
+        long key = predict_remaining(sim_jobs[j].predicted, sim_jobs[j].served) * (sim_njobs + 1L) + j;
+        heap_push(sim_ready_heap, &sim_ready_size, key, j);
+        return;
+    }
+    rq_push(&sim_queue, j, sim_jobs[j].priority);
+}
+
+// adds a job whose slice ran out, for rr it waits for the next round
+void sim_ready_requeue(int j, long now) {
+    if (sim_policy == POLICY_SJF) {
+        sim_ready_push(j, now);
+        return;
+    }
+    sim_jobs[j].ready_since = now;
+    rq_expire(&sim_queue, j, sim_jobs[j].priority);
+}
+
+int sim_ready_pop() {
+    if (sim_policy == POLICY_SJF) {
+        return sim_ready_size > 0 ? heap_pop(sim_ready_heap, &sim_ready_size).job : -1;
+    }
+    return rq_pop(&sim_queue);
+}
+
+// runs all jobs to completion and returns the virtual time at which the last one finished.
+// every job gets the burst prediction of its name when it arrives, and the prediction learns
+// from each job as it completes, the way the live scheduler learns across runs.
+long sim_run(int ncpu, int tslice, sched_policy policy) {
+    sim_policy = policy;
+    sim_ready_size = 0;
+    int *next = malloc((sim_njobs + 1) * sizeof(int));
+    sim_ready_heap = malloc((sim_njobs + 1) * sizeof(heap_ent));
+    heap_ent *io_heap = malloc((sim_njobs + 1) * sizeof(heap_ent));
+    int running[ncpu];
+    rq_init(&sim_queue, next);
+    if (next == NULL || sim_ready_heap == NULL || io_heap == NULL) {
+        perror("malloc failed in simulator");
+        exit(1);
+    }
+    int io_size = 0;
+    for (int cpu = 0; cpu < ncpu; cpu++) {
+        running[cpu] = -1;
+    }
+    for (int i = 0; i < sim_njobs; i++) { // jobs may have been run before under another policy
+        sim_jobs[i].phase = 0;
+        sim_jobs[i].wait = sim_jobs[i].served = sim_jobs[i].completion = 0;
+    }
+    predict_free();
+
+    long now = 0;
+    int next_arrival = 0, finished = 0;
+    while (finished < sim_njobs) {
+        // admit jobs that arrived or came back from io before this slice starts
+        while (next_arrival < sim_njobs && sim_jobs[next_arrival].arrival <= now) {
+            sim_job *job = &sim_jobs[next_arrival];
+            job->remaining = sim_bursts[job->burst_off];
+            job->predicted = predict_burst(sim_names + job->name_off, tslice);
+            sim_ready_push(next_arrival++, now);
+        }
+        while (io_size > 0 && io_heap[0].key <= now) {
+            sim_ready_push(heap_pop(io_heap, &io_size).job, now);
+        }
+
+        int busy = 0;
+        for (int cpu = 0; cpu < ncpu; cpu++) {
+            if (running[cpu] == -1 && (running[cpu] = sim_ready_pop()) != -1) {
+                sim_jobs[running[cpu]].wait += now - sim_jobs[running[cpu]].ready_since;
+            }
+            busy += running[cpu] != -1;
+        }
+
+        if (busy == 0) { // idle, skip ahead to the slice boundary of the next event
+            long next = -1;
+            if (next_arrival < sim_njobs) next = sim_jobs[next_arrival].arrival;
+            if (io_size > 0 && (next == -1 || io_heap[0].key < next)) next = io_heap[0].key;
+            now = ((next + tslice - 1) / tslice) * tslice;
+            continue;
+        }
+
+        for (int cpu = 0; cpu < ncpu; cpu++) {
+            int j = running[cpu];
+            if (j == -1) {
+                continue;
+            }
+            sim_job *job = &sim_jobs[j];
+            long used = job->remaining < tslice ? job->remaining : tslice;
+            job->remaining -= used;
+            job->served += used;
+            if (job->remaining > 0) { // preempted, back of the queue
+                sim_ready_requeue(j, now + tslice);
+            } else if (job->phase + 1 < job->nbursts) { // blocks on io, then continues with the next cpu phase
+                long io_done = now + used + sim_bursts[job->burst_off + job->phase + 1];
+                job->phase += 2;
+                job->remaining = sim_bursts[job->burst_off + job->phase];
+                heap_push(io_heap, &io_size, io_done, j);
+            } else {
+                job->completion = now + tslice; // like the live scheduler, completion is seen at the end of the slice
+                predict_update(sim_names + job->name_off, job->cpu_total);
+                finished++;
+            }
+            running[cpu] = -1;
+        }
+        now += tslice;
+    }
+    free(next);
+    free(sim_ready_heap);
+    free(io_heap);
+    return now;
+}
+
+double sim_mean_turnaround() {
+    double sum = 0;
+    for (int i = 0; i < sim_njobs; i++) {
+        sum += sim_jobs[i].completion - sim_jobs[i].arrival;
+    }
+    return sum / sim_njobs;
+}
+
+void sim_report(int ncpu, int tslice, sched_policy policy, long makespan, double wall_secs) {
+    long *turnaround = malloc(sim_njobs * sizeof(long));
+    if (turnaround == NULL) {
+        perror("malloc failed in simulator");
+        exit(1);
+    }
+    double sum_turn = 0, sum_wait = 0, sum_x = 0, sum_x2 = 0, cpu_busy = 0, sum_err = 0;
+    for (int i = 0; i < sim_njobs; i++) {
+        sim_job *job = &sim_jobs[i];
+        turnaround[i] = job->completion - job->arrival;
+        sum_turn += turnaround[i];
+        sum_wait += job->wait;
+        cpu_busy += job->cpu_total;
+        double x = turnaround[i] > 0 ? (double)job->cpu_total / turnaround[i] : 1.0; // share of its lifetime the job was served
+        sum_x += x;
+        sum_x2 += x * x;
+        sum_err += job->predicted > job->cpu_total ? job->predicted - job->cpu_total : job->cpu_total - job->predicted;
+    }
+    qsort(turnaround, sim_njobs, sizeof(long), sim_cmp_long);
+    long p99 = (99L * sim_njobs + 99) / 100 - 1; // nearest-rank percentile
+
+    printf("\n--- Simulation Report ---\n");
+    printf("Jobs: %d, NCPU=%d, TSLICE=%dms, policy=%s\n", sim_njobs, ncpu, tslice, policy == POLICY_SJF ? "sjf" : "rr");
+    printf("Makespan: %ld ms (virtual)\n", makespan);
+    printf("Throughput: %.3f jobs/s\n", makespan > 0 ? sim_njobs * 1000.0 / makespan : 0.0);
+    printf("Turnaround: mean %.2f ms, p99 %ld ms, max %ld ms\n", sum_turn / sim_njobs, turnaround[p99],
+           turnaround[sim_njobs - 1]);
+    printf("Wait time: mean %.2f ms\n", sum_wait / sim_njobs);
+    printf("CPU utilisation: %.2f%%\n", makespan > 0 ? 100.0 * cpu_busy / ((double)makespan * ncpu) : 0.0);
+    printf("Jain fairness index: %.4f\n", sum_x2 > 0 ? (sum_x * sum_x) / (sim_njobs * sum_x2) : 1.0);
+    printf("Prediction error: mean %.2f ms (%.1f%% of mean cpu time)\n", sum_err / sim_njobs,
+           cpu_busy > 0 ? 100.0 * sum_err / cpu_busy : 0.0);
+    printf("Simulation wall time: %.3f s\n", wall_secs);
+    printf("-------------------------\n");
+    free(turnaround);
+}
+
+int simulate_main(int argc, char **argv) {
+    if (argc < 5 || argc > 6) {
+        fprintf(stderr, "Usage: %s --simulate <trace> <NCPU> <TSLICE_ms> [rr|sjf]\n", argv[0]);
+        return 1;
+    }
+    int ncpu = atoi(argv[3]);
+    int tslice = atoi(argv[4]);
+    if (ncpu <= 0 || tslice <= 0) {
+        fprintf(stderr, "NCPU and TSLICE must be positive integers.\n");
+        return 1;
+    }
+    sched_policy policy = POLICY_RR;
+    if (argc == 6 && strcmp(argv[5], "sjf") == 0) {
+        policy = POLICY_SJF;
+    } else if (argc == 6 && strcmp(argv[5], "rr") != 0) {
+        fprintf(stderr, "Unknown policy '%s'.\n", argv[5]);
+        return 1;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    sim_load_trace(argv[2]);
+    if (sim_njobs == 0) {
+        fprintf(stderr, "Trace '%s' contains no jobs.\n", argv[2]);
+        return 1;
+    }
+    double rr_turnaround = 0;
+    if (policy != POLICY_RR) { // baseline for the comparison below
+        sim_run(ncpu, tslice, POLICY_RR);
+        rr_turnaround = sim_mean_turnaround();
+    }
+    long makespan = sim_run(ncpu, tslice, policy);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sim_report(ncpu, tslice, policy, makespan, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    if (policy != POLICY_RR) {
+        double turnaround = sim_mean_turnaround();
+        printf("Mean turnaround against rr: %.2f ms vs %.2f ms (%.1f%% lower)\n", turnaround, rr_turnaround,
+               rr_turnaround > 0 ? 100.0 * (rr_turnaround - turnaround) / rr_turnaround : 0.0);
+    }
+
+    predict_free();
+
+    free(sim_jobs);
+    free(sim_bursts);
+    free(sim_names);
+    return 0;
+}
+
+// ---------------- queue benchmark ----------------
+// cost of the ready queue work schedule() does every slice (dispatch ncpu jobs, preempt and requeue
+// them) with n jobs waiting, without sleeping or signalling. For comparison it also times the walk over
+// the whole ready queue that charged wait time every slice before wait time was accounted lazily.
+
+double bench_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int bench_main(int argc, char **argv) {
+    if (argc < 3 || argc > 4 || atoi(argv[2]) <= 0) {
+        fprintf(stderr, "Usage: %s --bench <NCPU> [rr|sjf]\n", argv[0]);
+        return 1;
+    }
+    int ncpu = atoi(argv[2]);
+    int running[ncpu];
+    sched_data = calloc(1, sizeof(scheduler_data));
+    if (sched_data == NULL) {
+        perror("calloc failed in benchmark");
+        exit(1);
+    }
+    sched_data->ncpu = ncpu;
+    sched_data->tslice = 10;
+    sched_data->policy = argc == 4 && strcmp(argv[3], "sjf") == 0 ? POLICY_SJF : POLICY_RR;
+    printf("%8s %16s %16s\n", "jobs", "queue ns/slice", "walk ns/slice");
+    for (int n = 100; n <= MAX_JOBS; n *= 10) {
+        rq_init(&ready_queue, ready_next);
+        heap_size = 0;
+        clock_ms = 0;
+        srand(1);
+        for (int i = 0; i < n; i++) {
+            job_states[i].status = READY;
+            job_states[i].time_slices_used = 0;
+            job_states[i].cpu_ms = 0;
+            job_states[i].wait_ms = 0;
+            job_states[i].predicted = 10 + rand() % 5000;
+            sched_data->job_priority[i] = rand() % 4;
+            enqueue(i);
+        }
+        int slices = 1000000;
+        double t0 = bench_seconds();
+        for (int s = 0; s < slices; s++) {
+            for (int cpu = 0; cpu < ncpu; cpu++) {
+                running[cpu] = dequeue();
+            }
+            clock_ms += sched_data->tslice;
+            for (int cpu = 0; cpu < ncpu; cpu++) {
+                job_states[running[cpu]].time_slices_used++;
+                job_states[running[cpu]].cpu_ms += sched_data->tslice;
+                requeue(running[cpu]);
+            }
+        }
+        double queue_ns = (bench_seconds() - t0) * 1e9 / slices;
+
+        int walk_slices = 100000000 / n; // the old per-slice walk, about 10^8 job visits in total
+        t0 = bench_seconds();
+        for (int s = 0; s < walk_slices; s++) {
+            for (int i = 0; i < n; i++) {
+                job_states[i].wait_ms += sched_data->tslice;
+            }
+            __asm__ volatile("" ::: "memory"); // keep the compiler from folding the slices together
+        }
+        double walk_ns = (bench_seconds() - t0) * 1e9 / walk_slices;
+        printf("%8d %16.1f %16.1f\n", n, queue_ns, walk_ns);
+    }
+    free(sched_data);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--simulate") == 0) {
+        return simulate_main(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        return bench_main(argc, argv);
+    }
+    if (argc == 3 && strcmp(argv[1], "--record") == 0) {
+        record_file = fopen(argv[2], "w");
+        if (record_file == NULL) {
+            perror("fopen failed for trace file");
+            exit(1);
+        }
+        fprintf(record_file, "# arrival_ms burst_ms priority name\n");
+    }
     signal(SIGTERM, cleanup_and_exit);
     signal(SIGINT, cleanup_and_exit);
     init_shared_memory();
-    round_robin_schedule();
+    predict_load(PREDICTION_FILE);
+    if (sched_data->adaptive && sched_data->backend == BACKEND_SIGNAL) {
+        slice_log = fopen(SLICE_LOG, "w");
+        if (slice_log == NULL) {
+            perror("fopen failed for slice log");
+        } else {
+            fprintf(slice_log, "# clock_ms runnable overhead_us slice_ms\n");
+        }
+    }
+    if (sched_data->backend == BACKEND_CGROUP && cgroup_start()) {
+        cgroup_schedule();
+    } else {
+        sched_data->backend = BACKEND_SIGNAL;
+        schedule();
+    }
+    print_report();
     cleanup_and_exit(0);
     return 0;
 }
@@ -0,0 +1,174 @@
+// File: workload.c
+// synthetic scheduler job: workload <profile> <cpu_ms> [param]
+//   cpu          spin for cpu_ms of cpu time
+//   mem          stream over a param MiB buffer (default 64) for cpu_ms of cpu time
+//   io           write and fsync 64 KiB blocks of a temporary file for cpu_ms of wall time
+//   bursty       cpu bursts of param ms (default 20) separated by sleeps just as long, cpu_ms of cpu in total
+//   interactive  1 ms of work after each param ms sleep (default 10), cpu_ms of cpu in total
+//   parallel     param forked processes (default 4) that each spin cpu_ms in 5 ms steps, meeting at a barrier after every step
+//   threads      the same with param threads in one process, like a parallel_for
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "dummy_main.h"
+
+#define STEP_MS 5
+
+double cpu_ms() { // of the calling thread
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+double wall_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+volatile unsigned long sink; // keeps the loops from being optimised away
+
+// burns ms of cpu time
+void spin(double ms) {
+    double end = cpu_ms() + ms;
+    unsigned long x = 1;
+    while (cpu_ms() < end) {
+        for (int i = 0; i < 10000; i++) x = x * 6364136223846793005UL + 1442695040888963407UL;
+    }
+    sink = x;
+}
+
+void sleep_ms(double ms) {
+    struct timespec ts = { (time_t)(ms / 1000), (long)((ms - (time_t)(ms / 1000) * 1000) * 1e6) };
+    nanosleep(&ts, NULL);
+}
+
+// one member of a parallel job: total ms of cpu in STEP_MS steps, waiting for all the others after each
+void barrier_steps(pthread_barrier_t *barrier, double total) {
+    for (double done = 0; done < total; done += STEP_MS) {
+        spin(STEP_MS < total - done ? STEP_MS : total - done);
+        pthread_barrier_wait(barrier);
+    }
+}
+
+typedef struct {
+    pthread_barrier_t *barrier;
+    double total;
+} member_args;
+
+void *member_thread(void *ptr) {
+    member_args *m = ptr;
+    barrier_steps(m->barrier, m->total);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || atof(argv[2]) <= 0) {
+        fprintf(stderr, "Usage: %s cpu|mem|io|bursty|interactive|parallel|threads <cpu_ms> [param]\n", argv[0]);
+        return 1;
+    }
+    char *profile = argv[1];
+    double total = atof(argv[2]);
+    double param = argc > 3 ? atof(argv[3]) : 0;
+
+    if (strcmp(profile, "cpu") == 0) {
+        spin(total);
+    } else if (strcmp(profile, "mem") == 0) {
+        size_t len = (size_t)(param > 0 ? param : 64) * 1024 * 1024 / sizeof(long);
+        long *buf = malloc(len * sizeof(long));
+        if (buf == NULL) {
+            perror("malloc failed");
+            return 1;
+        }
+        memset(buf, 1, len * sizeof(long));
+        double end = cpu_ms() + total;
+        long sum = 0;
+        while (cpu_ms() < end) {
+            for (size_t i = 0; i < len; i += 8) sum += buf[i]; // one load per cache line
+        }
+        sink = sum;
+        free(buf);
+    } else if (strcmp(profile, "io") == 0) {
+        char path[] = "/tmp/workload-XXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0) {
+            perror("mkstemp failed");
+            return 1;
+        }
+        unlink(path);
+        static char block[64 * 1024];
+        double end = wall_ms() + total;
+        while (wall_ms() < end) {
+            if (write(fd, block, sizeof(block)) != sizeof(block) || fsync(fd) < 0) {
+                perror("write failed");
+                return 1;
+            }
+            if (lseek(fd, 0, SEEK_CUR) > 64L * 1024 * 1024) {
+                lseek(fd, 0, SEEK_SET);
+            }
+        }
+        close(fd);
+    } else if (strcmp(profile, "bursty") == 0) {
+        double burst = param > 0 ? param : 20;
+        for (double done = 0; done < total; done += burst) {
+            spin(burst < total - done ? burst : total - done);
+            sleep_ms(burst);
+        }
+    } else if (strcmp(profile, "interactive") == 0) {
+        double think = param > 0 ? param : 10;
+        for (double done = 0; done < total; done += 1) {
+            sleep_ms(think);
+            spin(1);
+        }
+    } else if (strcmp(profile, "parallel") == 0 || strcmp(profile, "threads") == 0) {
+        int width = param >= 1 ? (int)param : 4;
+        int procs = strcmp(profile, "parallel") == 0;
+        // the barrier lives in shared memory so that forked members can use it too
+        pthread_barrier_t *barrier = mmap(NULL, sizeof(pthread_barrier_t), PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        pthread_barrierattr_t attr;
+        if (barrier == MAP_FAILED) {
+            perror("mmap failed");
+            return 1;
+        }
+        pthread_barrierattr_init(&attr);
+        pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_barrier_init(barrier, &attr, width);
+        pthread_t tid[width];
+        member_args args = { barrier, total };
+        for (int i = 1; i < width; i++) {
+            if (procs) {
+                pid_t pid = fork();
+                if (pid < 0) {
+                    perror("fork failed");
+                    return 1;
+                }
+                if (pid == 0) {
+                    barrier_steps(barrier, total);
+                    _exit(0);
+                }
+            } else if (pthread_create(&tid[i], NULL, member_thread, &args) != 0) {
+                fprintf(stderr, "Error in creating thread %d\n", i);
+                return 1;
+            }
+        }
+        barrier_steps(barrier, total);
+        for (int i = 1; i < width; i++) {
+            if (procs) {
+                wait(NULL);
+            } else {
+                pthread_join(tid[i], NULL);
+            }
+        }
+    } else {
+        fprintf(stderr, "Unknown profile '%s'.\n", profile);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/sh
+# N loader instances of the same binary at once, with file-backed segments and with copied pages (--copy).
+# Reports wall time and the summed resident (RSS) and proportional (PSS) memory of the instances.
+# Usage: ./bench.sh [instances] [executable]
+N=${1:-16}
+EXE=${2:-./shared}
+OUT=$(mktemp -d)
+for mode in "" --copy; do
+    t0=$(date +%s.%N)
+    i=0; while [ $i -lt $N ]; do ./loader $mode $EXE > "$OUT/$i" & i=$((i + 1)); done
+    wait
+    t1=$(date +%s.%N)
+    cat "$OUT"/* | awk -v a="$t0" -v b="$t1" -v n=$N -v m="${mode:-file-backed}" '
+        /Resident memory/ { rss += $3; pss += $6 }
+        /Time in fault handler/ { fault += $5 }
+        END { printf "%-12s %d instances: %.0f ms wall, %.2f ms in fault handlers, RSS %d KB, PSS %d KB\n", m, n, (b - a) * 1000, fault, rss, pss }'
+done
+rm -rf "$OUT"
@@ -0,0 +1,10 @@
+#define SIZE (4 * 1024 * 1024)
+int A[SIZE];   // 16 MiB of bss, walked sequentially
+int B[SIZE / 4] = { 1 };   // 4 MiB of data
+int _start() {
+  int sum = 0;
+  for (int i = 0; i < SIZE; i++) A[i] = i & 7;
+  for (int i = 0; i < SIZE / 4; i++) sum += B[i];
+  for (int i = 0; i < SIZE; i++) sum += A[i];
+  return sum;
+}
@@ -1,86 +1,491 @@
 #include "loader.h"
 
-Elf32_Ehdr *ehdr;
-Elf32_Phdr *phdr;
+Elf64_Ehdr *ehdr;
+Elf64_Phdr *phdr;
 int fd = -1;
 
+#define MODE_LAZY 0              // load modes, see preload_segments
+#define MODE_EAGER 1
+#define MODE_HYBRID 2
+
 // global variables
 int pageFault_counter = 0;       
 int pageAlloc_counter = 0;       
 int fragementation = 0;          
 long page_size = 4096;           
-int array_size = 0;              
-int *segment_index;              
 int segments_read = 0;
+int sequential_counter = 0;      // faults that grew a read-ahead window
+int prefetch_counter = 0;        // pages premapped from a fault trace
+int fault_around = 16;           // pages mapped per fault, --fault-around=N
+double fault_time = 0;           // seconds spent in the fault handler
+int load_mode = MODE_LAZY;       // --mode=eager|lazy|hybrid
+bool copy_pages = false;         // --copy: anonymous pages filled with pread instead of file mappings
+bool use_uffd = false;           // --backend=uffd: faults served by a userfaultfd thread instead of SIGSEGV
+int uffd = -1;
+char *uffd_buffer;               // staging buffer of the fault handler thread, one window
+bool use_hugepages = false;      // --hugepages: back aligned 2 MiB blocks of large segments with huge pages
+int hugetlb_counter = 0;         // blocks mapped with MAP_HUGETLB
+int thp_counter = 0;             // blocks mapped as transparent huge page candidates (MADV_HUGEPAGE)
+long mem_limit_pages = 0;        // --mem-limit: pages the loader may keep mapped, 0 for no limit
+long resident_pages = 0;         // pages mapped now, and the most at any time
+long peak_resident_pages = 0;
+int evict_counter = 0;
+int refault_counter = 0;         // pages mapped again after being evicted
+int sample_counter = 0;          // faults on pages the clock made PROT_NONE
+int dirty_counter = 0;           // first writes to pages of writable segments
+int clock_segment = 0;           // clock hand
+unsigned long clock_page = 0;
+bool record_trace = false;       // --record: write the faults of this run to <exe>.ftrace
+bool replay_trace = false;       // --replay-prefetch: premap the pages recorded in <exe>.ftrace
+double load_start;               // start of the load, fault trace times are relative to it
+bool use_cache = false;          // --cache: load through a pre-laid-out image in /dev/shm
+const char *cache_state = "off"; // off, cold (image built by this run) or warm (image reused)
+
+#define MAX_WINDOW 512           // read-ahead limit in pages (2 MiB)
+#define HUGE_PAGE (2UL << 20)
+
+// one PT_LOAD segment in the interval table. Built once at load time, sorted by address and binary-searched
+// on every fault; its size never changes afterwards.
+typedef struct {
+    unsigned long start, end;    // p_vaddr .. p_vaddr + p_memsz
+    unsigned long first_page;
+    unsigned long next;          // page right after the last window mapped in the segment
+    Elf64_Phdr *phdr;
+    unsigned long *bitmap;       // one bit per page, set once the page is mapped
+    unsigned long *referenced;   // --mem-limit page state, one bit per page each
+    unsigned long *sampled;      // made PROT_NONE by the clock to see if the page is used again
+    unsigned long *dirty;        // written, so it cannot be dropped
+    unsigned long *evicted;
+    unsigned long npages;
+    int window;                  // current window in pages
+    int faults;                  // per-segment counters
+    int pages;
+    unsigned long used;          // bytes of the segment covered by mapped pages
+} segment_info;
+
+segment_info *segments;
+int nsegments = 0;
+
+// fault trace (--record), kept in memory while the program runs and written to <exe>.ftrace after it returns.
+// Each record is a mapped window: its first page and length within a segment, and when it was mapped.
+#define TRACE_MAGIC 0x4543415254544c46UL   // "FLTTRACE"
+#define MAX_TRACE 65536
+typedef struct {
+    unsigned int page;           // first page of the window, counted from the segment's first page
+    unsigned short segment;      // index in the segment table
+    unsigned short pages;        // window length in pages
+    unsigned int usec;           // microseconds since the load started
+} fault_record;
+
+typedef struct {
+    unsigned long magic;
+    unsigned long size;          // the executable the trace belongs to
+    long mtime_sec, mtime_nsec;
+    int nsegments;
+    int count;
+} trace_header;
+
+fault_record *trace;
+int trace_count = 0;
+int trace_dropped = 0;
+
+// header of a cached image in /dev/shm. It is followed by the program headers, rewritten so that every
+// PT_LOAD segment points at its file pages in the image, and then by those pages, page-aligned.
+#define IMAGE_MAGIC 0x4547414d49464c45UL   // "ELFIMAGE"
+typedef struct {
+    unsigned long magic;
+    unsigned long dev, ino, size;           // key of the ELF file the image was built from
+    long mtime_sec, mtime_nsec;
+    Elf64_Ehdr ehdr;
+} image_header;
 
 void loader_cleanup() {
     if (fd >= 0) {
         close(fd);
     }
+    for (int i = 0; i < nsegments; i++) {
+        free(segments[i].bitmap);
+        free(segments[i].referenced);
+    }
+    free(segments);
     free(ehdr);
     free(phdr);
+    segments = NULL;
+    nsegments = 0;
+    ehdr = NULL;
+    phdr = NULL;
 }
 
-// checks if the segment has already been loaded
-bool segment_check(int segment) {
-    int count = 0;
-    for(int i = 0; i < array_size; i++) if (segment_index[i] == segment) count++;
-    return count == 1;
+// monotonic clock in seconds, safe to call from the signal handler
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-// SIGSEGV handler handles the page faults
-void sigsegv_handler(int signum, siginfo_t *info, void *context) {
-    pageFault_counter++;
-    unsigned long fault_addr = (unsigned long)info->si_addr;
+// binary search of the interval table, NULL if no segment holds the address
+segment_info *find_segment(unsigned long addr) {
+    int lo = 0, hi = nsegments - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (addr < segments[mid].start) {
+            hi = mid - 1;
+        } else if (addr >= segments[mid].end) {
+            lo = mid + 1;
+        } else {
+            return &segments[mid];
+        }
+    }
+    return NULL;
+}
 
-    // find which segment caused the fault
-    for (int i = 0; i < ehdr->e_phnum; i++) {
-        Elf32_Phdr *segment = &phdr[i];
+// per-page bits of a segment
+bool test_page(unsigned long *bits, segment_info *seg, unsigned long page_base) {
+    unsigned long page = (page_base - seg->first_page) / page_size;
+    return (bits[page / 64] >> (page % 64)) & 1;
+}
+
+void set_page(unsigned long *bits, segment_info *seg, unsigned long page_base) {
+    unsigned long page = (page_base - seg->first_page) / page_size;
+    bits[page / 64] |= 1UL << (page % 64);
+}
 
-        unsigned long seg_start = segment->p_vaddr;
-        unsigned long seg_end = segment->p_vaddr + segment->p_memsz;
+void clear_page(unsigned long *bits, segment_info *seg, unsigned long page_base) {
+    unsigned long page = (page_base - seg->first_page) / page_size;
+    bits[page / 64] &= ~(1UL << (page % 64));
+}
 
-        if (fault_addr >= seg_start && fault_addr < seg_end) {
+// true if the page at page_base of the segment is already mapped
+bool page_mapped(segment_info *seg, unsigned long page_base) {
+    return test_page(seg->bitmap, seg, page_base);
+}
 
-            // align fault address to page boundary
-            unsigned long page_base = fault_addr & ~(page_size - 1);
+void mark_mapped(segment_info *seg, unsigned long page_base) {
+    set_page(seg->bitmap, seg, page_base);
+}
 
-            // compute file offset for this page
-            unsigned long file_offset = segment->p_offset + (page_base - segment->p_vaddr);
+// page protection from the segment's p_flags
+int segment_prot(Elf64_Phdr *segment) {
+    int prot = 0;
+    if (segment->p_flags & PF_R) prot |= PROT_READ;
+    if (segment->p_flags & PF_W) prot |= PROT_WRITE;
+    if (segment->p_flags & PF_X) prot |= PROT_EXEC;
+    return prot;
+}
 
-            // determine how many bytes to read
-            size_t bytes_to_read = page_size;
-            if ((page_base + page_size) > seg_end) {
-                bytes_to_read = seg_end - page_base;
-            }
+// maps the pages [lo, hi) of a segment. Pages holding file data are mapped MAP_PRIVATE straight from the file,
+// so clean pages are shared with other runs of the same binary and nothing is copied. Only the page where the
+// file data ends has its tail zeroed, and the pages after it (bss) are anonymous. Segments whose offset and
+// address disagree modulo the page size, or --copy, fall back to anonymous pages filled with pread.
+// populate maps the pages in right away (eager loading) instead of on first touch.
+void map_window(Elf64_Phdr *segment, unsigned long lo, unsigned long hi, bool populate) {
+    unsigned long seg_start = segment->p_vaddr;
+    unsigned long file_end = seg_start + segment->p_filesz;
+    int prot = segment_prot(segment);
 
-            // mmap a single page lazily
-            void *mapped_page = mmap((void *)page_base, page_size,
-                                     PROT_READ | PROT_WRITE | PROT_EXEC,
-                                     MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS,
-                                     -1, 0);
-            if (mapped_page == MAP_FAILED) {
-                perror("mmap failed");
+    if (copy_pages || (segment->p_offset % page_size) != (seg_start % page_size)) {
+        void *mapped = mmap((void *)lo, hi - lo, PROT_READ | PROT_WRITE,
+                            MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) {
+            perror("mmap failed");
+            exit(1);
+        }
+        // copy the file-backed part of the window, the rest (bss) stays zero
+        unsigned long copy_start = lo > seg_start ? lo : seg_start;
+        unsigned long copy_end = file_end < hi ? file_end : hi;
+        if (copy_start < copy_end) {
+            unsigned long file_offset = segment->p_offset + (copy_start - seg_start);
+            if (pread(fd, (void *)copy_start, copy_end - copy_start, file_offset) < 0) {
+                perror("read failed in sigsegv_handler");
                 exit(1);
             }
+        }
+        if (mprotect((void *)lo, hi - lo, prot) < 0) {
+            perror("mprotect failed");
+            exit(1);
+        }
+        return;
+    }
 
-            // copy bytes from file into the mapped page
-            lseek(fd, file_offset, SEEK_SET);
-            int read_bytes = read(fd, mapped_page, bytes_to_read);
-            if (read_bytes < 0) {
-                perror("read failed in sigsegv_handler");
+    // pages that hold file bytes end at the page after file_end
+    unsigned long mid = (file_end + page_size - 1) & ~(page_size - 1);
+    if (mid > hi) mid = hi;
+    if (mid < lo) mid = lo;
+    if (lo < mid) {
+        bool partial = file_end < mid; // the last page continues with bss and is zeroed below
+        void *mapped = mmap((void *)lo, mid - lo, partial ? prot | PROT_WRITE : prot,
+                            MAP_FIXED | MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, segment->p_offset + lo - seg_start);
+        if (mapped == MAP_FAILED) {
+            perror("mmap failed");
+            exit(1);
+        }
+        if (partial) {
+            memset((void *)file_end, 0, mid - file_end);
+            if (!(prot & PROT_WRITE) && mprotect((void *)(mid - page_size), page_size, prot) < 0) {
+                perror("mprotect failed");
                 exit(1);
             }
+        }
+    }
+    if (mid < hi) {
+        void *mapped = mmap((void *)mid, hi - mid, prot,
+                            MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS | (populate ? MAP_POPULATE : 0), -1, 0);
+        if (mapped == MAP_FAILED) {
+            perror("mmap failed");
+            exit(1);
+        }
+    }
+}
+
+// marks [lo, hi) of the segment as mapped and updates the global and per-segment counters
+void account_window(segment_info *seg, unsigned long lo, unsigned long hi) {
+    for (unsigned long p = lo; p < hi; p += page_size) {
+        mark_mapped(seg, p);
+    }
+    unsigned long used_start = lo > seg->start ? lo : seg->start;
+    unsigned long used_end = hi < seg->end ? hi : seg->end;
+    seg->pages += (hi - lo) / page_size;
+    seg->used += used_end - used_start;
+    seg->next = hi;
+    pageAlloc_counter += (hi - lo) / page_size;
+    resident_pages += (hi - lo) / page_size;
+    segments_read += used_end - used_start;
+    fragementation = (pageAlloc_counter * page_size) - segments_read;
+}
+
+// appends a mapped window to the fault trace, safe in the signal handler since the buffer is preallocated
+void record_fault(segment_info *seg, unsigned long lo, unsigned long hi) {
+    if (!record_trace) {
+        return;
+    }
+    if (trace_count == MAX_TRACE) {
+        trace_dropped++;
+        return;
+    }
+    fault_record *r = &trace[trace_count++];
+    r->page = (lo - seg->first_page) / page_size;
+    r->segment = seg - segments;
+    r->pages = (hi - lo) / page_size;
+    r->usec = (now_seconds() - load_start) * 1e6;
+}
+
+// picks the window of pages to map for a fault on page_base: read-ahead from the fault on sequential access,
+// else the aligned block around it, shrunk to the unmapped run holding the fault since mapping over a loaded
+// page would discard it. A fault on the page right after the previous window of the same segment is taken as
+// sequential access and doubles that segment's window.
+void pick_window(segment_info *seg, unsigned long page_base, unsigned long *lo_out, unsigned long *hi_out) {
+    unsigned long first_page = seg->first_page;
+    unsigned long end_page = (seg->end + page_size - 1) & ~(page_size - 1);
+    unsigned long lo, hi;
+    if (fault_around > 1 && page_base == seg->next) {
+        seg->window = seg->window * 2 > MAX_WINDOW ? MAX_WINDOW : seg->window * 2;
+        sequential_counter++;
+        lo = page_base;
+    } else {
+        seg->window = fault_around;
+        lo = first_page + ((page_base - first_page) / (fault_around * page_size)) * (fault_around * page_size);
+    }
+    hi = lo + seg->window * page_size;
+    if (hi > end_page) {
+        hi = end_page;
+    }
+    for (unsigned long p = page_base - page_size; p >= lo && p < page_base; p -= page_size) {
+        if (page_mapped(seg, p)) {
+            lo = p + page_size;
+            break;
+        }
+    }
+    for (unsigned long p = page_base + page_size; p < hi; p += page_size) {
+        if (page_mapped(seg, p)) {
+            hi = p;
+            break;
+        }
+    }
+    // --mem-limit: a window may take a quarter of the budget at most
+    if (mem_limit_pages && (hi - lo) / page_size > (unsigned long)mem_limit_pages / 4 + 1) {
+        lo = page_base;
+        hi = lo + (mem_limit_pages / 4 + 1) * page_size < hi ? lo + (mem_limit_pages / 4 + 1) * page_size : hi;
+    }
+    *lo_out = lo;
+    *hi_out = hi;
+}
+
+// --hugepages: maps the whole 2 MiB-aligned block around a fault at once if it lies inside the segment and
+// none of it is loaded yet. It is backed by a huge page from the hugetlb pool if there is one, else by an
+// anonymous mapping advised with MADV_HUGEPAGE so the kernel can use a transparent huge page, else by plain
+// pages. Huge pages are anonymous, so the file bytes are copied in and the block then gets the segment's
+// permissions. Returns false if the block is not eligible and the normal window should be used.
+bool map_huge_window(segment_info *seg, unsigned long page_base) {
+    unsigned long block = page_base & ~(HUGE_PAGE - 1);
+    unsigned long end_page = (seg->end + page_size - 1) & ~(page_size - 1);
+    if (block < seg->first_page || block + HUGE_PAGE > end_page) {
+        return false;
+    }
+    for (unsigned long p = block; p < block + HUGE_PAGE; p += page_size) {
+        if (page_mapped(seg, p)) {
+            return false;
+        }
+    }
+    void *mapped = mmap((void *)block, HUGE_PAGE, PROT_READ | PROT_WRITE,
+                        MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mapped != MAP_FAILED) {
+        hugetlb_counter++;
+    } else {
+        mapped = mmap((void *)block, HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) {
+            perror("mmap failed");
+            exit(1);
+        }
+        if (madvise(mapped, HUGE_PAGE, MADV_HUGEPAGE) == 0) {
+            thp_counter++;
+        }
+    }
+    unsigned long file_end = seg->start + seg->phdr->p_filesz;
+    unsigned long copy_start = block > seg->start ? block : seg->start;
+    unsigned long copy_end = file_end < block + HUGE_PAGE ? file_end : block + HUGE_PAGE;
+    if (copy_start < copy_end &&
+        pread(fd, (void *)copy_start, copy_end - copy_start, seg->phdr->p_offset + (copy_start - seg->start)) < 0) {
+        perror("read failed in sigsegv_handler");
+        exit(1);
+    }
+    if (mprotect(mapped, HUGE_PAGE, segment_prot(seg->phdr)) < 0) {
+        perror("mprotect failed");
+        exit(1);
+    }
+    account_window(seg, block, block + HUGE_PAGE);
+    record_fault(seg, block, block + HUGE_PAGE);
+    return true;
+}
+
+// --mem-limit: a fault on a page that is mapped already is either the clock's sampling (the page was made
+// PROT_NONE and is now used again) or the first write to a clean page of a writable segment, which is mapped
+// read-only until then. Returns false for a real permission violation.
+bool tracking_fault(segment_info *seg, unsigned long page_base) {
+    int prot = segment_prot(seg->phdr);
+    if (test_page(seg->sampled, seg, page_base)) {
+        clear_page(seg->sampled, seg, page_base);
+        set_page(seg->referenced, seg, page_base);
+        sample_counter++;
+        if (!test_page(seg->dirty, seg, page_base)) {
+            prot &= ~PROT_WRITE;
+        }
+    } else if ((prot & PROT_WRITE) && !test_page(seg->dirty, seg, page_base)) {
+        set_page(seg->dirty, seg, page_base);
+        set_page(seg->referenced, seg, page_base);
+        dirty_counter++;
+    } else {
+        return false;
+    }
+    if (mprotect((void *)page_base, page_size, prot) < 0) {
+        perror("mprotect failed");
+        exit(1);
+    }
+    return true;
+}
+
+// --mem-limit: after a window [lo, hi) of cur was mapped, runs the clock over all segment pages until the
+// loader is within its budget again. A referenced page loses its bit and becomes PROT_NONE, so using it again
+// faults and sets the bit (sampling); an unreferenced clean page is dropped with MADV_DONTNEED and left
+// PROT_NONE, so the next access refaults it like a page that was never loaded. Dirty pages only exist in
+// memory and are skipped, as is the window just mapped. The hand moves at most one turn per call, so a page
+// sampled now can only be evicted by a later fault, after the faulting instruction had the chance to use it
+// again; two turns let the code page and the data page of one instruction evict each other forever.
+void enforce_mem_limit(segment_info *cur, unsigned long lo, unsigned long hi) {
+    unsigned long steps = 0, limit = 0;
+    for (int i = 0; i < nsegments; i++) limit += segments[i].npages;
+    while (resident_pages > mem_limit_pages && steps++ < limit) {
+        segment_info *seg = &segments[clock_segment];
+        if (clock_page >= seg->npages) {
+            clock_page = 0;
+            clock_segment = (clock_segment + 1) % nsegments;
+            steps--;
+            continue;
+        }
+        unsigned long addr = seg->first_page + clock_page++ * page_size;
+        if (!page_mapped(seg, addr) || test_page(seg->dirty, seg, addr) || (seg == cur && addr >= lo && addr < hi)) {
+            continue;
+        }
+        if (test_page(seg->referenced, seg, addr)) {
+            clear_page(seg->referenced, seg, addr);
+            if (!test_page(seg->sampled, seg, addr)) {
+                set_page(seg->sampled, seg, addr);
+                mprotect((void *)addr, page_size, PROT_NONE);
+            }
+            continue;
+        }
+        if (madvise((void *)addr, page_size, MADV_DONTNEED) < 0 || mprotect((void *)addr, page_size, PROT_NONE) < 0) {
+            perror("evicting a page failed");
+            exit(1);
+        }
+        clear_page(seg->bitmap, seg, addr);
+        clear_page(seg->sampled, seg, addr);
+        set_page(seg->evicted, seg, addr);
+        resident_pages--;
+        evict_counter++;
+    }
+}
 
-            // update stats
-            pageAlloc_counter++;
-            segments_read += bytes_to_read;
-            fragementation = (pageAlloc_counter * page_size) - segments_read;
+// --mem-limit: state of a freshly mapped window. Its pages start referenced, evicted pages that came back
+// are counted as refaults, and clean pages of writable segments are made read-only to catch the first write.
+void track_window(segment_info *seg, unsigned long lo, unsigned long hi) {
+    for (unsigned long p = lo; p < hi; p += page_size) {
+        set_page(seg->referenced, seg, p);
+        if (test_page(seg->evicted, seg, p)) {
+            clear_page(seg->evicted, seg, p);
+            refault_counter++;
+        }
+    }
+    int prot = segment_prot(seg->phdr);
+    if ((prot & PROT_WRITE) && mprotect((void *)lo, hi - lo, prot & ~PROT_WRITE) < 0) {
+        perror("mprotect failed");
+        exit(1);
+    }
+    enforce_mem_limit(seg, lo, hi);
+    if (resident_pages > peak_resident_pages) {
+        peak_resident_pages = resident_pages;
+    }
+}
+
+// SIGSEGV handler handles the page faults. Instead of a single page it maps a window of unmapped pages around
+// the faulting one, see pick_window and map_window. With the userfaultfd backend missing pages never get here,
+// so a fault inside a segment is always a permission violation.
+void sigsegv_handler(int signum, siginfo_t *info, void *context) {
+    double t0 = now_seconds();
+    pageFault_counter++;
+    unsigned long fault_addr = (unsigned long)info->si_addr;
+
+    // find which segment caused the fault
+    segment_info *seg = find_segment(fault_addr);
+    if (seg) {
+        seg->faults++;
+
+        // align fault address to page boundary
+        unsigned long page_base = fault_addr & ~(page_size - 1);
+        if (mem_limit_pages && page_mapped(seg, page_base) && tracking_fault(seg, page_base)) {
+            fault_time += now_seconds() - t0;
+            return;
+        }
+        if (use_uffd || page_mapped(seg, page_base)) { // loaded already, so the access broke the segment's permissions
+            fprintf(stderr, "Permission violation at address: %p\n", info->si_addr);
+            exit(1);
+        }
+
+        if (use_hugepages && map_huge_window(seg, page_base)) {
+            fault_time += now_seconds() - t0;
+            return;
+        }
+        unsigned long lo, hi;
+        pick_window(seg, page_base, &lo, &hi);
+        map_window(seg->phdr, lo, hi, false);
 
-            // keep record of which segment was touched
-            segment_index[array_size++] = i;
-            return;  
+        // update stats
+        account_window(seg, lo, hi);
+        record_fault(seg, lo, hi);
+        if (mem_limit_pages) {
+            track_window(seg, lo, hi);
         }
+        fault_time += now_seconds() - t0;
+        return;
     }
 
     // Invalid memory access
@@ -88,42 +493,534 @@ void sigsegv_handler(int signum, siginfo_t *info, void *context) {
     exit(1);
 }
 
-void load_and_run_elf(char **exe) {
-    fd = open(exe[1], O_RDONLY);
+// userfaultfd backend: serves one missing-page fault from the handler thread. The window is assembled in a
+// staging buffer (file bytes read with pread, zeros elsewhere) and placed with a single UFFDIO_COPY, which
+// maps the pages and wakes the faulting thread. A bss-only window of a read-only segment uses UFFDIO_ZEROPAGE;
+// writable segments get copied zero pages instead, since the shared zero page would take a second fault on
+// the first write.
+void serve_uffd_fault(unsigned long fault_addr) {
+    double t0 = now_seconds();
+    pageFault_counter++;
+    segment_info *seg = find_segment(fault_addr);
+    unsigned long page_base = fault_addr & ~(page_size - 1);
+    if (!seg) { // registered ranges are whole pages, so this is the gap before or after a segment
+        fprintf(stderr, "Invalid memory access at address: %p\n", (void *)fault_addr);
+        exit(1);
+    }
+    seg->faults++;
 
-    if (fd < 0) {
-        perror("Opening Error");
+    unsigned long lo, hi;
+    pick_window(seg, page_base, &lo, &hi);
+    unsigned long file_end = seg->start + seg->phdr->p_filesz;
+    unsigned long copy_start = lo > seg->start ? lo : seg->start;
+    unsigned long copy_end = file_end < hi ? file_end : hi;
+    if (copy_start < copy_end || (seg->phdr->p_flags & PF_W)) {
+        memset(uffd_buffer, 0, hi - lo);
+        if (copy_start < copy_end && pread(fd, uffd_buffer + (copy_start - lo), copy_end - copy_start,
+                  seg->phdr->p_offset + (copy_start - seg->start)) < 0) {
+            perror("read failed in fault handler thread");
+            exit(1);
+        }
+        struct uffdio_copy copy = { .dst = lo, .src = (unsigned long)uffd_buffer, .len = hi - lo, .mode = UFFDIO_COPY_MODE_DONTWAKE };
+        if (ioctl(uffd, UFFDIO_COPY, &copy) < 0 && errno != EEXIST) {
+            perror("UFFDIO_COPY failed");
+            exit(1);
+        }
+    } else {
+        struct uffdio_zeropage zero = { .range = { .start = lo, .len = hi - lo }, .mode = UFFDIO_ZEROPAGE_MODE_DONTWAKE };
+        if (ioctl(uffd, UFFDIO_ZEROPAGE, &zero) < 0 && errno != EEXIST) {
+            perror("UFFDIO_ZEROPAGE failed");
+            exit(1);
+        }
+    }
+    // the faulting thread is only woken once the counters are updated, it may be about to print them
+    account_window(seg, lo, hi);
+    record_fault(seg, lo, hi);
+    fault_time += now_seconds() - t0;
+    struct uffdio_range wake = { .start = lo, .len = hi - lo };
+    if (ioctl(uffd, UFFDIO_WAKE, &wake) < 0) {
+        perror("UFFDIO_WAKE failed");
         exit(1);
     }
+}
 
-    // allocate memory 
-    ehdr = (Elf32_Ehdr *)malloc(sizeof(Elf32_Ehdr));
-    if (!ehdr) {
-        perror("ehdr allocation error");          // Error handled
-        loader_cleanup();
+void *uffd_thread(void *arg) {
+    struct uffd_msg msg;
+    while (1) {
+        ssize_t n = read(uffd, &msg, sizeof(msg));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n != sizeof(msg)) {
+            perror("userfaultfd read failed");
+            exit(1);
+        }
+        if (msg.event == UFFD_EVENT_PAGEFAULT) {
+            serve_uffd_fault(msg.arg.pagefault.address);
+        }
+    }
+    return NULL;
+}
+
+// sets up the userfaultfd backend: every segment that is not loaded yet becomes an anonymous mapping with the
+// segment's permissions, registered for missing-page faults, and a thread serves them. Falls back to the
+// SIGSEGV backend if userfaultfd is not available (kernel support or vm.unprivileged_userfaultfd).
+void start_uffd_backend() {
+    // user-mode-only faults are enough for the program and allowed without privileges
+    uffd = syscall(SYS_userfaultfd, O_CLOEXEC | UFFD_USER_MODE_ONLY);
+    if (uffd < 0) {
+        uffd = syscall(SYS_userfaultfd, O_CLOEXEC);
+    }
+    struct uffdio_api api = { .api = UFFD_API, .features = 0 };
+    if (uffd < 0 || ioctl(uffd, UFFDIO_API, &api) < 0) {
+        fprintf(stderr, "userfaultfd unavailable (%s), using the SIGSEGV backend\n", strerror(errno));
+        if (uffd >= 0) {
+            close(uffd);
+        }
+        use_uffd = false;
+        return;
+    }
+    uffd_buffer = (char *)mmap(NULL, MAX_WINDOW * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (uffd_buffer == MAP_FAILED) {
+        perror("mmap failed");
+        exit(1);
+    }
+    for (int i = 0; i < nsegments; i++) {
+        segment_info *seg = &segments[i];
+        if (seg->pages > 0) { // loaded up front by --mode=eager or hybrid
+            continue;
+        }
+        unsigned long len = ((seg->end + page_size - 1) & ~(page_size - 1)) - seg->first_page;
+        if (mmap((void *)seg->first_page, len, segment_prot(seg->phdr), MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) == MAP_FAILED) {
+            perror("mmap failed");
+            exit(1);
+        }
+        struct uffdio_register reg = { .range = { .start = seg->first_page, .len = len }, .mode = UFFDIO_REGISTER_MODE_MISSING };
+        if (ioctl(uffd, UFFDIO_REGISTER, &reg) < 0) {
+            perror("UFFDIO_REGISTER failed");
+            exit(1);
+        }
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, uffd_thread, NULL) != 0) {
+        perror("pthread_create failed");
         exit(1);
     }
+    pthread_detach(thread);
+}
 
-    if (read(fd, ehdr, sizeof(Elf32_Ehdr)) != sizeof(Elf32_Ehdr)) {
-        perror("Reading ELF header error");       // Error handled
+// builds the interval table of PT_LOAD segments, sorted by address, with a page bitmap for each
+void setup_segments() {
+    segments = (segment_info *)calloc(ehdr->e_phnum, sizeof(segment_info));
+    if (!segments) {
+        perror("segment table allocation error");
         loader_cleanup();
         exit(1);
     }
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type != PT_LOAD || phdr[i].p_memsz == 0) {
+            continue;
+        }
+        // insertion sort, program headers are normally in address order already
+        int j = nsegments++;
+        while (j > 0 && segments[j - 1].start > phdr[i].p_vaddr) {
+            segments[j] = segments[j - 1];
+            j--;
+        }
+        segment_info *seg = &segments[j];
+        memset(seg, 0, sizeof(*seg));
+        seg->phdr = &phdr[i];
+        seg->start = phdr[i].p_vaddr;
+        seg->end = phdr[i].p_vaddr + phdr[i].p_memsz;
+        seg->first_page = seg->start & ~(page_size - 1);
+        seg->window = fault_around;
+        unsigned long pages = (seg->end - seg->first_page + page_size - 1) / page_size;
+        seg->npages = pages;
+        seg->bitmap = (unsigned long *)calloc(pages / 64 + 1, sizeof(unsigned long));
+        if (mem_limit_pages) { // the four page state bitmaps share one block
+            seg->referenced = (unsigned long *)calloc(4 * (pages / 64 + 1), sizeof(unsigned long));
+            seg->sampled = seg->referenced + (pages / 64 + 1);
+            seg->dirty = seg->sampled + (pages / 64 + 1);
+            seg->evicted = seg->dirty + (pages / 64 + 1);
+        }
+        if (!seg->bitmap || (mem_limit_pages && !seg->referenced)) {
+            perror("page bitmap allocation error");
+            loader_cleanup();
+            exit(1);
+        }
+    }
+    for (int i = 1; i < nsegments; i++) {
+        if (segments[i].start < segments[i - 1].end) {
+            fprintf(stderr, "Overlapping PT_LOAD segments\n");
+            loader_cleanup();
+            exit(1);
+        }
+    }
+}
 
-    // allocate memory for program headers and read them
-    phdr = (Elf32_Phdr *)malloc(ehdr->e_phentsize * ehdr->e_phnum);
-    if (!phdr) {
-        perror("phdr allocation error");          // Error handled
-        loader_cleanup();
+// eager and hybrid modes: maps whole segments before _start runs. The kernel is told the file will be read so
+// its readahead starts early, and MAP_POPULATE faults every page in during the mmap. eager loads every PT_LOAD
+// segment, hybrid only the one holding e_entry and leaves the others to the fault handler.
+void preload_segments() {
+    if (load_mode == MODE_LAZY) {
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    for (int i = 0; i < nsegments; i++) {
+        segment_info *seg = &segments[i];
+        if (load_mode == MODE_HYBRID && seg != find_segment(ehdr->e_entry)) {
+            continue;
+        }
+        unsigned long hi = (seg->end + page_size - 1) & ~(page_size - 1);
+        map_window(seg->phdr, seg->first_page, hi, true);
+        account_window(seg, seg->first_page, hi);
+    }
+}
+
+// key of a fault trace, so a trace of an older build of the executable is not replayed
+bool trace_key(const char *path, trace_header *hdr) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        return false;
+    }
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->magic = TRACE_MAGIC;
+    hdr->size = st.st_size;
+    hdr->mtime_sec = st.st_mtim.tv_sec;
+    hdr->mtime_nsec = st.st_mtim.tv_nsec;
+    hdr->nsegments = nsegments;
+    return true;
+}
+
+void write_trace(const char *path) {
+    char name[PATH_MAX];
+    trace_header hdr;
+    snprintf(name, sizeof(name), "%s.ftrace", path);
+    if (!trace_key(path, &hdr)) {
+        return;
+    }
+    hdr.count = trace_count;
+    int out = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0 || write(out, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        write(out, trace, sizeof(fault_record) * trace_count) != (ssize_t)(sizeof(fault_record) * trace_count)) {
+        perror("Writing fault trace error");
         exit(1);
     }
+    close(out);
+    printf("Fault trace: %d windows written to %s", trace_count, name);
+    if (trace_dropped) {
+        printf(", %d dropped", trace_dropped);
+    }
+    printf("\n");
+}
 
-    lseek(fd, ehdr->e_phoff, SEEK_SET);
-    if (read(fd, phdr, ehdr->e_phentsize * ehdr->e_phnum) != (ehdr->e_phentsize * ehdr->e_phnum)) {
-        perror("Reading program header error");   // Error handled
+// --replay-prefetch: maps the windows of a recorded trace in the order they faulted, populated, before _start.
+// The program then runs with the recorded working set already in place and only pages it did not touch in
+// the recorded run stay unmapped. A missing or stale trace leaves plain lazy loading.
+void replay_prefetch(const char *path) {
+    char name[PATH_MAX];
+    trace_header hdr, key;
+    snprintf(name, sizeof(name), "%s.ftrace", path);
+    int in = open(name, O_RDONLY);
+    if (in < 0 || read(in, &hdr, sizeof(hdr)) != sizeof(hdr) || !trace_key(path, &key) || hdr.magic != key.magic ||
+        hdr.size != key.size || hdr.mtime_sec != key.mtime_sec || hdr.mtime_nsec != key.mtime_nsec ||
+        hdr.nsegments != key.nsegments || hdr.count < 0 || hdr.count > MAX_TRACE) {
+        fprintf(stderr, "No usable fault trace in %s, loading lazily\n", name);
+        if (in >= 0) {
+            close(in);
+        }
+        return;
+    }
+    fault_record *records = (fault_record *)malloc(sizeof(fault_record) * (hdr.count + 1));
+    if (!records || read(in, records, sizeof(fault_record) * hdr.count) != (ssize_t)(sizeof(fault_record) * hdr.count)) {
+        fprintf(stderr, "Truncated fault trace in %s, loading lazily\n", name);
+        free(records);
+        close(in);
+        return;
+    }
+    close(in);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    for (int r = 0; r < hdr.count; r++) {
+        if (records[r].segment >= nsegments) {
+            continue;
+        }
+        segment_info *seg = &segments[records[r].segment];
+        unsigned long end_page = (seg->end + page_size - 1) & ~(page_size - 1);
+        unsigned long lo = seg->first_page + (unsigned long)records[r].page * page_size;
+        unsigned long hi = lo + (unsigned long)records[r].pages * page_size;
+        if (hi > end_page) {
+            hi = end_page;
+        }
+        // map the unmapped runs of the window, the eager and hybrid modes may have loaded parts already
+        while (lo < hi) {
+            while (lo < hi && page_mapped(seg, lo)) lo += page_size;
+            unsigned long run = lo;
+            while (run < hi && !page_mapped(seg, run)) run += page_size;
+            if (lo < run) {
+                map_window(seg->phdr, lo, run, true);
+                account_window(seg, lo, run);
+                prefetch_counter += (run - lo) / page_size;
+            }
+            lo = run;
+        }
+    }
+    free(records);
+}
+
+// one row per segment, each character a group of pages: ' ' none mapped, then . : * # for up to a quarter,
+// half, three quarters and all of the group's pages mapped
+void print_heatmap() {
+    const int width = 64;
+    printf("Page heatmap (%d columns per segment):\n", width);
+    for (int i = 0; i < nsegments; i++) {
+        segment_info *seg = &segments[i];
+        unsigned long pages = (((seg->end + page_size - 1) & ~(page_size - 1)) - seg->first_page) / page_size;
+        unsigned long per_column = (pages + width - 1) / width;
+        char row[width + 1];
+        int columns = 0;
+        for (unsigned long first = 0; first < pages; first += per_column) {
+            unsigned long last = first + per_column < pages ? first + per_column : pages;
+            unsigned long mapped = 0;
+            for (unsigned long p = first; p < last; p++) {
+                mapped += page_mapped(seg, seg->first_page + p * page_size);
+            }
+            unsigned long quarter = (4 * mapped + (last - first) - 1) / (last - first);
+            row[columns++] = " .:*#"[quarter];
+        }
+        row[columns] = '\0';
+        printf("  %#lx %5lu pages |%s|\n", seg->start, pages, row);
+    }
+}
+
+// number of VMAs (lines of /proc/self/maps) of the loader with the program loaded
+int count_vmas() {
+    FILE *f = fopen("/proc/self/maps", "r");
+    char line[512];
+    int count = 0;
+    if (!f) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+// opens a counter of data TLB read misses of this process in user space, -1 if the CPU, the kernel or
+// perf_event_paranoid do not allow it
+int open_dtlb_counter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// resident and proportional set size of the loader, PSS splits shared file pages between the processes mapping them
+void print_resident() {
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    long rss = -1, pss = -1, huge = 0;
+    if (!f) {
+        return;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, "Rss: %ld", &rss);
+        sscanf(line, "Pss: %ld", &pss);
+        sscanf(line, "AnonHugePages: %ld", &huge);
+    }
+    fclose(f);
+    printf("Resident memory: %ld KB, proportional: %ld KB, in transparent huge pages: %ld KB\n", rss, pss, huge);
+}
+
+// name of the cached image of an ELF file, keyed by the user and the device, inode, modification time and size
+void image_name(struct stat *st, char *name, size_t len) {
+    snprintf(name, len, "/dev/shm/loader-%u-%lx-%lx-%lx-%lx.img", (unsigned)geteuid(), (unsigned long)st->st_dev,
+             (unsigned long)st->st_ino,
+             (unsigned long)st->st_mtim.tv_sec * 1000000000UL + st->st_mtim.tv_nsec, (unsigned long)st->st_size);
+}
+
+// warm start: takes the headers from the cached image and uses the image instead of the ELF file, so the
+// ELF file is not opened. /dev/shm is shared by every user, so the image is only trusted if it is a regular file
+// of our own that nobody else can write, and its headers are checked like read_elf_headers() checks the ELF
+// file's. Returns false if there is no valid image.
+bool open_cached_image(const char *path) {
+    struct stat st, image_st;
+    char name[128];
+    image_header hdr;
+    if (stat(path, &st) < 0) {
+        return false;
+    }
+    image_name(&st, name, sizeof(name));
+    int image_fd = open(name, O_RDONLY | O_NOFOLLOW);
+    if (image_fd < 0) {
+        return false;
+    }
+    if (fstat(image_fd, &image_st) < 0 || !S_ISREG(image_st.st_mode) || image_st.st_uid != geteuid() ||
+        (image_st.st_mode & (S_IWGRP | S_IWOTH))) {
+        fprintf(stderr, "Ignoring image cache %s, not a private file of this user\n", name);
+        close(image_fd);
+        return false;
+    }
+    if (pread(image_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr.magic != IMAGE_MAGIC ||
+        hdr.dev != (unsigned long)st.st_dev || hdr.ino != (unsigned long)st.st_ino ||
+        hdr.size != (unsigned long)st.st_size || hdr.mtime_sec != st.st_mtim.tv_sec ||
+        hdr.mtime_nsec != st.st_mtim.tv_nsec || !check_elf_header(&hdr.ehdr)) {
+        close(image_fd);
+        return false;
+    }
+    size_t table_size = sizeof(Elf64_Phdr) * hdr.ehdr.e_phnum;
+    ehdr = (Elf64_Ehdr *)malloc(sizeof(Elf64_Ehdr));
+    phdr = (Elf64_Phdr *)malloc(table_size);
+    if (!ehdr || !phdr) {
+        perror("header allocation error");
         loader_cleanup();
         exit(1);
     }
+    *ehdr = hdr.ehdr;
+    bool ok = pread(image_fd, phdr, table_size, sizeof(hdr)) == (ssize_t)table_size;
+    // every segment's file data must lie inside the image, or mapping it would fault past its end
+    for (int i = 0; i < ehdr->e_phnum && ok; i++) {
+        ok = phdr[i].p_type != PT_LOAD ||
+             (phdr[i].p_filesz <= phdr[i].p_memsz && phdr[i].p_offset <= (unsigned long)image_st.st_size &&
+              phdr[i].p_filesz <= (unsigned long)image_st.st_size - phdr[i].p_offset);
+    }
+    if (!ok) {
+        fprintf(stderr, "Ignoring damaged image cache %s\n", name);
+        close(image_fd);
+        free(ehdr);
+        free(phdr);
+        ehdr = NULL;
+        phdr = NULL;
+        return false;
+    }
+    fd = image_fd;
+    return true;
+}
+
+// cold start: lays the file data of the PT_LOAD segments out page by page in a new image, partial pages zeroed,
+// and switches fd and the program headers over to it. The image is written under a temporary name and renamed,
+// so concurrent loaders only ever see complete images. Without /dev/shm the ELF file is used as before.
+void build_cached_image(const char *path) {
+    struct stat st;
+    char name[128], tmp[160];
+    if (fstat(fd, &st) < 0) {
+        return;
+    }
+    image_name(&st, name, sizeof(name));
+    snprintf(tmp, sizeof(tmp), "%s.%d", name, getpid());
+    int image_fd = open(tmp, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (image_fd < 0) {
+        fprintf(stderr, "Image cache unavailable for %s, loading uncached\n", path);
+        return;
+    }
+
+    // lay out the segments after the header and program headers
+    Elf64_Phdr *table = (Elf64_Phdr *)malloc(sizeof(Elf64_Phdr) * ehdr->e_phnum);
+    if (!table) {
+        perror("image allocation error");
+        exit(1);
+    }
+    memcpy(table, phdr, sizeof(Elf64_Phdr) * ehdr->e_phnum);
+    unsigned long offset = (sizeof(image_header) + sizeof(Elf64_Phdr) * ehdr->e_phnum + page_size - 1) & ~(page_size - 1);
+    bool ok = true;
+    for (int i = 0; i < ehdr->e_phnum && ok; i++) {
+        if (phdr[i].p_type != PT_LOAD || phdr[i].p_memsz == 0) {
+            continue;
+        }
+        unsigned long first_page = phdr[i].p_vaddr & ~(page_size - 1);
+        unsigned long end_page = (phdr[i].p_vaddr + phdr[i].p_filesz + page_size - 1) & ~(page_size - 1);
+        unsigned long start = offset + (phdr[i].p_vaddr - first_page);
+        if (phdr[i].p_filesz > 0) {
+            char *data = (char *)malloc(phdr[i].p_filesz);
+            ok = data && pread(fd, data, phdr[i].p_filesz, phdr[i].p_offset) == (ssize_t)phdr[i].p_filesz &&
+                 pwrite(image_fd, data, phdr[i].p_filesz, start) == (ssize_t)phdr[i].p_filesz;
+            free(data);
+        }
+        // the page holding the end of the file data is zero-filled in the image, so mapping it needs no
+        // zeroing; the bss pages after it stay anonymous and take no space in /dev/shm
+        table[i].p_offset = start;
+        if (phdr[i].p_filesz > 0) {
+            table[i].p_filesz = (end_page < phdr[i].p_vaddr + phdr[i].p_memsz ? end_page : phdr[i].p_vaddr + phdr[i].p_memsz) - phdr[i].p_vaddr;
+        }
+        offset += end_page - first_page;
+    }
+
+    image_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = IMAGE_MAGIC;
+    hdr.dev = st.st_dev;
+    hdr.ino = st.st_ino;
+    hdr.size = st.st_size;
+    hdr.mtime_sec = st.st_mtim.tv_sec;
+    hdr.mtime_nsec = st.st_mtim.tv_nsec;
+    hdr.ehdr = *ehdr;
+    ok = ok && ftruncate(image_fd, offset) == 0 &&
+         pwrite(image_fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+         pwrite(image_fd, table, sizeof(Elf64_Phdr) * ehdr->e_phnum, sizeof(hdr)) == (ssize_t)(sizeof(Elf64_Phdr) * ehdr->e_phnum) &&
+         rename(tmp, name) == 0;
+    if (!ok) {
+        fprintf(stderr, "Could not write image cache for %s, loading uncached\n", path);
+        unlink(tmp);
+        close(image_fd);
+        free(table);
+        return;
+    }
+    close(fd);
+    fd = image_fd;
+    memcpy(phdr, table, sizeof(Elf64_Phdr) * ehdr->e_phnum);
+    free(table);
+}
+
+void load_and_run_elf(char **exe) {
+    load_start = now_seconds();
+    if (mem_limit_pages && (load_mode != MODE_LAZY || use_uffd || use_hugepages || replay_trace)) {
+        fprintf(stderr, "--mem-limit loads lazily with the SIGSEGV backend and without huge pages or prefetch\n");
+        load_mode = MODE_LAZY;
+        use_uffd = use_hugepages = replay_trace = false;
+    }
+    if (use_cache && open_cached_image(exe[1])) {
+        cache_state = "warm";
+    } else {
+        fd = open(exe[1], O_RDONLY);
+
+        if (fd < 0) {
+            perror("Opening Error");
+            exit(1);
+        }
+
+        read_elf_headers();
+        if (use_cache) {
+            build_cached_image(exe[1]);
+            cache_state = "cold";
+        }
+    }
+
+    setup_segments();
+    preload_segments();
+    if (replay_trace) {
+        replay_prefetch(exe[1]);
+    }
+    if (record_trace) {
+        trace = (fault_record *)malloc(sizeof(fault_record) * MAX_TRACE);
+        if (!trace) {
+            perror("trace allocation error");
+            loader_cleanup();
+            exit(1);
+        }
+    }
+    if (use_uffd && use_hugepages) {
+        fprintf(stderr, "--hugepages works with the SIGSEGV backend only, ignoring it\n");
+        use_hugepages = false;
+    }
+    if (use_uffd) {
+        start_uffd_backend();
+    }
 
     // Setup SIGSEGV handler for page faults
     struct sigaction page_fault;
@@ -139,7 +1036,23 @@ void load_and_run_elf(char **exe) {
 
     // Starting the execution from the entry point (_start)
     int (*_start)() = (int (*)())ehdr->e_entry;
+    int dtlb = open_dtlb_counter();
+    if (dtlb >= 0) {
+        ioctl(dtlb, PERF_EVENT_IOC_RESET, 0);
+        ioctl(dtlb, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    double start = now_seconds();
     int result = _start();
+    double total = now_seconds() - start;
+    long long dtlb_misses = -1;
+    if (dtlb >= 0) {
+        ioctl(dtlb, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(dtlb, &dtlb_misses, sizeof(dtlb_misses)) != sizeof(dtlb_misses)) {
+            dtlb_misses = -1;
+        }
+        close(dtlb);
+    }
+    double load_time = start - load_start;
 
     float frag = fragementation/1024.0;   // conversion of fragmentations from Bytes to KB
 
@@ -148,16 +1061,91 @@ void load_and_run_elf(char **exe) {
     printf("Number of Page Faults: %d\n", pageFault_counter);
     printf("Number of Pages Allocated: %d\n", pageAlloc_counter);
     printf("Internal Fragmentations: %f KB\n", frag);
+    printf("VMAs: %d, ", count_vmas());
+    if (dtlb_misses >= 0) {
+        printf("dTLB read misses: %lld\n", dtlb_misses);
+    } else {
+        printf("dTLB read misses: unavailable\n");
+    }
+    if (use_hugepages) {
+        printf("Huge page blocks: %d from hugetlb, %d advised for THP\n", hugetlb_counter, thp_counter);
+    }
+    printf("Fault-around window: %d pages, %d sequential faults\n", fault_around, sequential_counter);
+    printf("Time in fault handler: %.3f ms of %.3f ms total (%s backend)\n", fault_time * 1000, total * 1000,
+           use_uffd ? "userfaultfd" : "SIGSEGV");
+    printf("Load time before _start: %.3f ms (%s, image cache %s)\n", load_time * 1000,
+           load_mode == MODE_EAGER ? "eager" : load_mode == MODE_HYBRID ? "hybrid" : "lazy", cache_state);
+    for (int i = 0; i < nsegments; i++) {
+        segment_info *seg = &segments[i];
+        printf("Segment %#lx-%#lx %c%c%c: %d faults, %d pages, %.3f KB fragmentation\n", seg->start, seg->end,
+               seg->phdr->p_flags & PF_R ? 'r' : '-', seg->phdr->p_flags & PF_W ? 'w' : '-',
+               seg->phdr->p_flags & PF_X ? 'x' : '-', seg->faults, seg->pages,
+               (seg->pages * page_size - seg->used) / 1024.0);
+    }
+    if (mem_limit_pages) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        printf("Memory limit: %ld pages, peak %ld pages mapped, %d evictions, %d refaults\n", mem_limit_pages,
+               peak_resident_pages, evict_counter, refault_counter);
+        printf("Tracking faults: %d from sampling, %d first writes, peak RSS of the process: %ld KB\n", sample_counter,
+               dirty_counter, usage.ru_maxrss);
+    }
+    if (record_trace || replay_trace) {
+        print_heatmap();
+    }
+    if (replay_trace) {
+        printf("Pages prefetched from the fault trace: %d\n", prefetch_counter);
+    }
+    if (record_trace) {
+        write_trace(exe[1]);
+    }
+    print_resident();
 }
 
 int main(int argc, char **argv) {
 
+    // options come before the executable
+    while (argc > 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (strncmp(argv[1], "--fault-around=", 15) == 0 && atoi(argv[1] + 15) > 0) {
+            fault_around = atoi(argv[1] + 15) < MAX_WINDOW ? atoi(argv[1] + 15) : MAX_WINDOW;
+        } else if (strcmp(argv[1], "--mode=lazy") == 0) {
+            load_mode = MODE_LAZY;
+        } else if (strcmp(argv[1], "--mode=eager") == 0) {
+            load_mode = MODE_EAGER;
+        } else if (strcmp(argv[1], "--mode=hybrid") == 0) {
+            load_mode = MODE_HYBRID;
+        } else if (strcmp(argv[1], "--backend=uffd") == 0) {
+            use_uffd = true;
+        } else if (strcmp(argv[1], "--backend=sigsegv") == 0) {
+            use_uffd = false;
+        } else if (strcmp(argv[1], "--hugepages") == 0) {
+            use_hugepages = true;
+        } else if (strcmp(argv[1], "--record") == 0) {
+            record_trace = true;
+        } else if (strcmp(argv[1], "--replay-prefetch") == 0) {
+            replay_trace = true;
+        } else if (strcmp(argv[1], "--cache") == 0) {
+            use_cache = true;
+        } else if (strncmp(argv[1], "--mem-limit=", 12) == 0 && atol(argv[1] + 12) > 0) {
+            char *unit = argv[1] + 12 + strspn(argv[1] + 12, "0123456789");
+            long bytes = atol(argv[1] + 12) * (*unit == 'M' ? 1024 * 1024 : *unit == 'K' ? 1024 : 1);
+            mem_limit_pages = bytes / page_size > 0 ? bytes / page_size : 1;
+        } else if (strcmp(argv[1], "--copy") == 0) {
+            copy_pages = true;
+        } else {
+            printf("Unknown option: %s\n", argv[1]);
+            exit(1);
+        }
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+
     // if only loader is run without any helper files like fib.c & sum.c
     if (argc != 2) {
-        printf("Usage: %s <ELF Executable>\n", argv[0]);
+        printf("Usage: %s [--mode=eager|lazy|hybrid] [--backend=sigsegv|uffd] [--fault-around=N] [--copy] [--cache] [--hugepages] [--record | --replay-prefetch] [--mem-limit=N[K|M]] <ELF Executable>\n", argv[0]);
         exit(1);
     }
-    segment_index = (int *)malloc(100 * sizeof(int));
 
     load_and_run_elf(argv);
     loader_cleanup();
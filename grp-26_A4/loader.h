@@ -7,9 +7,20 @@
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include <signal.h>
 #include <ucontext.h>
 #include <stdbool.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#include <linux/perf_event.h>
+#include "../group-26/starter/elf_headers.h" // ELF32/ELF64 header reading shared with the starter loaders
 
 // #ifndef MAP_ANONYMOUS
 #define MAP_ANONYMOUS 0x20
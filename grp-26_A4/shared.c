@@ -0,0 +1,8 @@
+#define SIZE (2 * 1024 * 1024)
+const int T[SIZE] = { 1, 2, 3 };   // 8 MiB of read-only data, shared between loader runs when file-backed
+int _start() {
+  int sum = 0;
+  for (int pass = 0; pass < 50; pass++)
+    for (int i = 0; i < SIZE; i++) sum += T[i];
+  return sum;
+}
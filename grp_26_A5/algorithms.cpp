@@ -0,0 +1,82 @@
+#include "parallel-algorithms.h"
+#include <assert.h>
+
+//seconds since an arbitrary start
+double now(){
+  return std::chrono::duration<double>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+void report(const char *name, long size, double serial, double parallel){
+  printf("%-16s %12ld %10.3f %10.3f %8.2fx\n", name, size, serial, parallel, serial / parallel);
+}
+
+//compares each parallel algorithm with its std:: version on size random ints
+void bench(long size, int numThread){
+  int* A = new int[size];
+  int* B = new int[size];
+  int* C = new int[size];
+  //random non-negative input, generated in parallel
+  parallel_chunks(0, size, [=](long low, long high, int) {
+    for (long i = low; i < high; i++){
+      unsigned long x = (i + 1) * 0x9E3779B97F4A7C15UL;
+      x ^= x >> 29; x *= 0xBF58476D1CE4E5B9UL; x ^= x >> 32;
+      A[i] = (int)(x & 0x7fffffff);
+    }
+  }, numThread);
+  double t;
+
+  //sort
+  std::copy(A, A+size, B);
+  std::copy(A, A+size, C);
+  t = now(); std::sort(B, B+size); double serial = now() - t;
+  t = now(); parallel_sort(C, C+size, numThread); double parallel = now() - t;
+  assert(std::equal(B, B+size, C));
+  report("sort", size, serial, parallel);
+
+  //transform
+  auto op = [](int x) { return (int)((x * 7L + 3) % 1000003); };
+  t = now(); std::transform(A, A+size, B, op); serial = now() - t;
+  t = now(); parallel_transform(A, A+size, C, op, numThread); parallel = now() - t;
+  assert(std::equal(B, B+size, C));
+  report("transform", size, serial, parallel);
+
+  //copy_if
+  auto pred = [](int x) { return x % 3 == 0; };
+  t = now(); int* endB = std::copy_if(A, A+size, B, pred); serial = now() - t;
+  t = now(); int* endC = parallel_copy_if(A, A+size, C, pred, numThread); parallel = now() - t;
+  assert(endB - B == endC - C && std::equal(B, endB, C));
+  report("copy_if", size, serial, parallel);
+
+  //partition
+  std::copy(A, A+size, B);
+  std::copy(A, A+size, C);
+  t = now(); endB = std::stable_partition(B, B+size, pred); serial = now() - t;
+  t = now(); endC = parallel_partition(C, C+size, pred, numThread); parallel = now() - t;
+  assert(endB - B == endC - C && std::equal(B, B+size, C));
+  report("partition", size, serial, parallel);
+
+  //find_first, the only match three quarters in
+  A[size / 4 * 3] = -1;
+  auto match = [](int x) { return x < 0; };
+  t = now(); int* foundB = std::find_if(A, A+size, match); serial = now() - t;
+  t = now(); int* foundC = parallel_find_first(A, A+size, match, numThread); parallel = now() - t;
+  assert(foundB == foundC && foundC == A + size / 4 * 3);
+  report("find_first", size, serial, parallel);
+
+  delete[] A;
+  delete[] B;
+  delete[] C;
+}
+
+int main(int argc, char** argv) {
+  // intialize problem size, sizes grow tenfold from 10^6 up to size
+  int numThread = argc>1 ? atoi(argv[1]) : 2;
+  long size = argc>2 ? atol(argv[2]) : 100000000;
+  printf("%-16s %12s %10s %10s %9s\n", "algorithm", "elements", "std s", "parallel s", "speedup");
+  for (long n = 1000000; n <= size; n *= 10) {
+    bench(n, numThread);
+  }
+  if (size < 1000000) bench(size, numThread);
+  printf("Test Success\n");
+  return 0;
+}
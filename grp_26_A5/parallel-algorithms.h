@@ -0,0 +1,181 @@
+#include "simple-multithreader.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+//STL-style parallel algorithms on top of parallel_chunks. They take the same arguments as the std::
+//versions plus NTHREADS, and split the range into one chunk per thread, in order.
+//parallel_sort and parallel_partition need a contiguous range (an array or std::vector) of default
+//constructible values, since they merge and partition through a buffer of the same size.
+
+//elements handed out at a time by parallel_find_first
+#define FIND_BLOCK 16384
+
+//parallel std::transform
+template <typename InIt, typename OutIt, typename UnaryOp>
+OutIt parallel_transform(InIt first, InIt last, OutIt out, UnaryOp op, int NTHREADS){
+  long n = last - first;
+  parallel_chunks(0, n, [&](long low, long high, int) {
+    std::transform(first + low, first + high, out + low, op);
+  }, NTHREADS);
+  return out + n;
+}
+
+//number of elements taken from a among the first k of the stable merge of a and b (merge path),
+//so that a chunk of the merged output can be produced without the chunks before it
+template <typename T, typename Compare>
+long merge_split(const T *a, long na, const T *b, long nb, long k, Compare comp){
+  long low = k > nb ? k - nb : 0;
+  long high = k < na ? k : na;
+  while (low < high){
+    long i = (low + high) / 2;
+    if (!comp(b[k - i - 1], a[i])) low = i + 1; //a[i] goes before b[k-i-1], take more from a
+    else high = i;
+  }
+  return low;
+}
+
+//parallel std::sort: every thread sorts its chunk, then pairs of sorted runs are merged until one is
+//left. Each merge round splits its whole output evenly over the threads, so the last rounds with few
+//long runs keep every thread busy too. Not stable, like std::sort
+template <typename It, typename Compare>
+void parallel_sort(It first, It last, Compare comp, int NTHREADS){
+  typedef typename std::iterator_traits<It>::value_type T;
+  long n = last - first;
+  if (n < 2) return;
+  if (NTHREADS < 1) NTHREADS = 1;
+  T *data = &*first;
+
+  std::vector<long> runs(NTHREADS + 1, 0); //run r is [runs[r], runs[r+1])
+  parallel_chunks(0, n, [&](long low, long high, int tid) {
+    std::sort(data + low, data + high, comp);
+    runs[tid + 1] = high;
+  }, NTHREADS);
+  if (NTHREADS == 1) return;
+
+  std::unique_ptr<T[]> buf(new T[n]);
+  T *src = data, *dst = buf.get();
+  while (runs.size() > 2){
+    //merge run 2p with run 2p+1 from src into dst, an odd run at the end is merged with nothing
+    parallel_chunks(0, n, [&](long low, long high, int) {
+      for (size_t r = 0; r + 1 < runs.size(); r += 2){
+        long start = runs[r], mid = runs[r + 1];
+        long end = r + 2 < runs.size() ? runs[r + 2] : mid;
+        long k0 = std::max(low, start) - start, k1 = std::min(high, end) - start;
+        if (k0 >= k1) continue;
+        long i0 = merge_split(src + start, mid - start, src + mid, end - mid, k0, comp);
+        long i1 = merge_split(src + start, mid - start, src + mid, end - mid, k1, comp);
+        std::merge(src + start + i0, src + start + i1, src + mid + (k0 - i0), src + mid + (k1 - i1),
+                   dst + start + k0, comp);
+      }
+    }, NTHREADS);
+    std::vector<long> merged;
+    for (size_t r = 0; r < runs.size(); r += 2) merged.push_back(runs[r]);
+    if (merged.back() != n) merged.push_back(n);
+    runs.swap(merged);
+    std::swap(src, dst);
+  }
+  if (src != data){
+    parallel_chunks(0, n, [&](long low, long high, int) {
+      std::copy(src + low, src + high, data + low);
+    }, NTHREADS);
+  }
+}
+
+template <typename It>
+void parallel_sort(It first, It last, int NTHREADS){
+  parallel_sort(first, last, std::less<typename std::iterator_traits<It>::value_type>(), NTHREADS);
+}
+
+//parallel std::copy_if: every thread marks and counts the matches in its chunk, an exclusive scan of
+//the counts gives each chunk its offset in the output, then every thread copies its matches there.
+//Keeps the order, and calls pred once per element
+template <typename InIt, typename OutIt, typename Pred>
+OutIt parallel_copy_if(InIt first, InIt last, OutIt out, Pred pred, int NTHREADS){
+  long n = last - first;
+  if (NTHREADS < 1) NTHREADS = 1;
+  std::unique_ptr<unsigned char[]> keep(new unsigned char[n]);
+  std::vector<long> offset(NTHREADS + 1, 0);
+  parallel_chunks(0, n, [&](long low, long high, int tid) {
+    long count = 0;
+    for (long i = low; i < high; i++){
+      keep[i] = pred(first[i]) ? 1 : 0;
+      count += keep[i];
+    }
+    offset[tid + 1] = count;
+  }, NTHREADS);
+  for (int t = 0; t < NTHREADS; t++) offset[t + 1] += offset[t];
+  parallel_chunks(0, n, [&](long low, long high, int tid) {
+    OutIt o = out + offset[tid];
+    for (long i = low; i < high; i++){
+      if (keep[i]) *o++ = first[i];
+    }
+  }, NTHREADS);
+  return out + offset[NTHREADS];
+}
+
+//parallel std::stable_partition, with the same scan as parallel_copy_if: elements that satisfy pred
+//go to the front and the rest after them, both in their original order. Returns the partition point
+template <typename It, typename Pred>
+It parallel_partition(It first, It last, Pred pred, int NTHREADS){
+  typedef typename std::iterator_traits<It>::value_type T;
+  long n = last - first;
+  if (n == 0) return first;
+  if (NTHREADS < 1) NTHREADS = 1;
+  T *data = &*first;
+  std::unique_ptr<unsigned char[]> keep(new unsigned char[n]);
+  std::vector<long> front(NTHREADS + 1, 0), back(NTHREADS + 1, 0);
+  parallel_chunks(0, n, [&](long low, long high, int tid) {
+    long count = 0;
+    for (long i = low; i < high; i++){
+      keep[i] = pred(data[i]) ? 1 : 0;
+      count += keep[i];
+    }
+    front[tid + 1] = count;
+    back[tid + 1] = (high - low) - count;
+  }, NTHREADS);
+  for (int t = 0; t < NTHREADS; t++){
+    front[t + 1] += front[t];
+    back[t + 1] += back[t];
+  }
+  long split = front[NTHREADS];
+
+  std::unique_ptr<T[]> buf(new T[n]);
+  parallel_chunks(0, n, [&](long low, long high, int tid) {
+    long f = front[tid], b = split + back[tid];
+    for (long i = low; i < high; i++){
+      if (keep[i]) buf[f++] = std::move(data[i]);
+      else buf[b++] = std::move(data[i]);
+    }
+  }, NTHREADS);
+  parallel_chunks(0, n, [&](long low, long high, int) {
+    std::move(buf.get() + low, buf.get() + high, data + low);
+  }, NTHREADS);
+  return first + split;
+}
+
+//parallel std::find_if: threads take FIND_BLOCK elements at a time in order, and once a match is
+//found no thread starts a block after it. Every block before the match was handed out and is
+//searched to the end, so the first match is still the one returned
+template <typename It, typename Pred>
+It parallel_find_first(It first, It last, Pred pred, int NTHREADS){
+  long n = last - first;
+  std::atomic<long> next(0);  //start of the next block to hand out
+  std::atomic<long> found(n); //lowest match so far, n if none
+  parallel_chunks(0, NTHREADS < 1 ? 1 : NTHREADS, [&](long, long, int) {
+    long low;
+    while ((low = next.fetch_add(FIND_BLOCK)) < n && low < found.load()){
+      long high = std::min(low + FIND_BLOCK, n);
+      for (long i = low; i < high; i++){
+        if (pred(first[i])){
+          long best = found.load();
+          while (i < best && !found.compare_exchange_weak(best, i));
+          break;
+        }
+      }
+    }
+  }, NTHREADS);
+  return first + found.load();
+}
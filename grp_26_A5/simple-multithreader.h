@@ -130,6 +130,56 @@ void parallel_for(int low_1, int high_1, int low_2, int high_2, std::function<vo
     std::cout << "Execution time: " << elapsed_time.count() << " seconds\n";
 }
 
+//arguments for chunked Parallel for
+typedef struct {
+  long low;
+  long high;
+  int tid;
+  std::function<void(long, long, int)> *lambda;
+} thread_args_chunk;
+
+//thread function for chunked Parallel for
+void *thread_func_chunk(void *ptr){
+  thread_args_chunk *t = static_cast<thread_args_chunk*> (ptr);
+  (*t->lambda)(t->low, t->high, t->tid); // whole range in one call
+  return NULL;
+}
+
+//chunked Parallel for: thread tid gets one call with its range [low, high), ranges are in thread order.
+//No timing output and long ranges, this is the layer the parallel algorithms are built on
+void parallel_chunks(long low, long high, std::function<void(long, long, int)> &&lambda, int NTHREADS){
+  if (NTHREADS < 1) NTHREADS = 1;
+  pthread_t tid[NTHREADS];
+  thread_args_chunk args[NTHREADS];
+  long chunk = (high - low) / NTHREADS; //size of each chunk
+
+  int i = 0;
+  while (i < NTHREADS){
+    //ranges for each thread, the last one takes the remainder
+    args[i].low = low + i * chunk;
+    args[i].high = (i == NTHREADS-1) ? high : args[i].low + chunk;
+    args[i].tid = i;
+    args[i].lambda = &lambda;
+    //the calling thread runs the last range itself
+    if (i < NTHREADS-1 && pthread_create(&tid[i], nullptr, thread_func_chunk, &args[i]) != 0){
+      std::cerr << "Error creating thread " << i << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    i++;
+  }
+  thread_func_chunk(&args[NTHREADS-1]);
+
+  //join threads
+  i = 0;
+  while (i < NTHREADS-1){
+    if (pthread_join(tid[i], nullptr) != 0){
+      std::cerr << "Error joining thread " << i << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    i++;
+  }
+}
+
 int main(int argc, char **argv) {
   //call user main
   int rc = user_main(argc, argv);